@@ -1,55 +1,32 @@
 #include "stdafx.h"
 #include "analysis.h"
-
-// hide from linkage
-namespace {
-    // trp[i]: total permutations of rolling i dice: 1, 6, 36, ...
-    int total_roll_perms[MAX_ROLLS + 1];
-
-    // trps[i][j]: # ways to get sum j by rolling i dice
-    int total_roll_perms_for_sum[MAX_ROLLS + 1][DICE_SIDES * MAX_ROLLS + 1];
-
-    // prs[i][j]: probability of getting sum j by rolling i dice; = trps[i][j] / trp[i]
-    double prob_roll_sum[MAX_ROLLS + 1][DICE_SIDES * MAX_ROLLS + 1];
-
-    // pars[i]: probability of getting sum i by rolling any number (1-10) of dice; = sum(prs[0][i] ... prs[10][i]) / 10.0
-    double prob_any_roll_sum[DICE_SIDES * MAX_ROLLS + 1];
-
-    // ptns[i][j][k]: probability of being on (turn_num % 8) = i at player scores (j,k); 
-    //                used to approximate likelihood of getting a time trot turn
-    double prob_turn_num_at_score[MOD_TROT][GOAL][GOAL];
-
-    // wrs[i][j][t]: gives (x,y), where 
-    // x is the first player's win rate at score (i,j), where it is the first player's turn. 
-    // y is the best strategy to use
-    // if t is 1, Time Trot is enabled at the current turn. else it is disabled.
-    std::pair<double, int> win_rate_at_score[GOAL][GOAL][2];
-
-    bool perms_computed = false, turn_num_computed = false;
-
-    // helper function for adding & swapping scores
-    inline void add_swap_scores(int & score0, int & score1, int add0 = 0) {
-        score0 += add0;
-        if (!enable_swine_swap) return;
-        if (is_swap(score0, score1)) std::swap(score0, score1);
-    }
-}
+#include "pool.h"
+#include "transition.h"
+#include "simd.h"
 
 // *** Implementation of LearningStrategy class ***
 
 void LearningStrategy::learn(IStrategy & oppo_strat, int number,
     std::pair<int, int>focus, volatile int * interrupt, bool quiet, int announce_interval, int wr_interval) {
-        MatrixStrategy testStrat = MatrixStrategy(*this, "_learn");
+        /* Only one cell changes at a time, so keep the DP table and only recompute the states
+           depending on that cell after each change */
+        IncrementalWinRate eval(*this, oppo_strat);
+        long long initial_states = eval.states_touched();
+
+        /* The evaluator holds copies of both strategies. Learning against itself, the opponent is this strategy,
+           so each change is made to the opponent's copy as well. */
+        bool self_play = &oppo_strat == this;
+        int evaluations = 0;
 
         if (!quiet) {
             std::cout << "Learning procedure started.\n" << "Initial win rate: ";
-            std::cout << average_win_rate(testStrat, oppo_strat, -1, 0, 0, 0) << "\n" << std::endl;
+            std::cout << eval.win_rate() << "\n" << std::endl;
         }
 
         for (int i = 0; i < number; ++i) {
             if (interrupt && *interrupt) break;
 
-            double best_awr = average_win_rate(testStrat, oppo_strat, -1, 0, 0, 0);
+            double best_awr = eval.win_rate();
 
             int rn = get_roll_num(focus.first, focus.second);
             int best_rolls = rn;
@@ -57,9 +34,11 @@ void LearningStrategy::learn(IStrategy & oppo_strat, int number,
             for (int j = 0; j <= MAX_ROLLS; ++j) {
                 if (j == rn) continue;
 
-                testStrat.set_roll_num(focus.first, focus.second, j);
+                eval.set_roll_num(0, focus.first, focus.second, j);
+                if (self_play) eval.set_roll_num(1, focus.first, focus.second, j);
+                ++evaluations;
 
-                double awr = average_win_rate(testStrat, oppo_strat, -1, 0, 0, 0);
+                double awr = eval.win_rate();
 
                 if (awr > best_awr) {
                     best_awr = awr;
@@ -67,7 +46,8 @@ void LearningStrategy::learn(IStrategy & oppo_strat, int number,
                 }
             }
 
-            testStrat.set_roll_num(focus.first, focus.second, best_rolls);
+            eval.set_roll_num(0, focus.first, focus.second, best_rolls);
+            if (self_play) eval.set_roll_num(1, focus.first, focus.second, best_rolls);
 
             set_roll_num(focus.first, focus.second, best_rolls);
 
@@ -94,9 +74,28 @@ void LearningStrategy::learn(IStrategy & oppo_strat, int number,
             }
             else {
                 std::cout << "\nLearning complete. Computing final win rate...\n";
-                std::cout << "Final win rate: " << average_win_rate(testStrat, oppo_strat, -1, 0, 0, 0) << std::endl;
+                std::cout << "Final win rate: " << eval.win_rate() << std::endl;
             }
+
+            if (evaluations > 0) {
+                std::cout << "States recomputed per evaluation: " <<
+                    (eval.states_touched() - initial_states) / evaluations << " on average, of " <<
+                    IncrementalWinRate::total_states() << " for a full computation" << std::endl;
+            }
+        }
+}
+
+void LearningStrategy::seed_best_response(IStrategy & oppo_strat) {
+    MatrixStrategy * best = create_best_response(oppo_strat, true);
+
+    for (int i = 0; i < GOAL; ++i) {
+        for (int j = 0; j < GOAL; ++j) {
+            set_roll_num(i, j, best->get_roll_num(i, j));
         }
+    }
+
+    delete best;
+    if (file_path != "") write_to_file(file_path);
 }
 
 std::pair<int, int> LearningStrategy::next_focus(std::pair<int, int> focus) {
@@ -125,475 +124,992 @@ std::pair<int, int> LearningStrategy::next_focus(std::pair<int, int> focus) {
     return focus;
 }
 
-/* Part of the final strategy implementation.
-computes the number of ways to get each number by rolling each number of dice. complexity n^2 * m*/
-void compute_perms() {
-    memset(total_roll_perms_for_sum, 0, sizeof total_roll_perms_for_sum);
-    memset(prob_any_roll_sum, 0, sizeof prob_any_roll_sum);
-    memset(prob_roll_sum, 0, sizeof prob_roll_sum);
+// *** Win rate computations ***
 
-    total_roll_perms[0] = 1;
-    total_roll_perms_for_sum[0][0] = 1; // base case
+/* storage class for win rate computation DP. States are stored as one plane per (who, turn, trot),
+   indexed by TransitionTable::index(score, oppo_score), so that the successors of a state are
+   gathered from a single contiguous plane. (Outside the unnamed namespace so that
+   IncrementalWinRate can own one.) */
+class WinRateStorage{
+    
+public:	
+    const static int PLANES = 2 * MOD_TROT * 2;
+    const static int SIZE = GOAL * GOAL * PLANES;
+    
+    // get the value stored for a specified state
+    inline double get(int score, int oppo_score, int who, int turn, int trot){
+        return plane(who, turn, trot)[TransitionTable::index(score, oppo_score)];
+    }
 
-    for (int i = 1; i <= MAX_ROLLS; ++i) {
+    // set the value stored for a specified state to 'value'
+    inline void set(int score, int oppo_score, int who, int turn, int trot, double value){
+        plane(who, turn, trot)[TransitionTable::index(score, oppo_score)] = value;
+    }
 
-        total_roll_perms[i] = total_roll_perms[i - 1] * DICE_SIDES;
+    // get the plane holding the states with the specified who, turn and trot
+    inline double * plane(int who, int turn, int trot) {
+        return val + ((who * MOD_TROT + turn) * 2 + trot) * GOAL * GOAL;
+    }
 
-        // the lowest possible sum for the previous number of rolls
-        int prev_low = 2 * (i - 1);
+    // Default constructor, allocates space for state array
+    WinRateStorage(void) : states(0) {
+        val = new double [ SIZE ];
+    }
 
-        // used to add up all the permutations so we can see if the sum matches the expected total.
-        int check_sum = 0;
+    /* Copy constructor does NOT actually copy the old array.
+       Definined like this to make vector.resize work. */
+    WinRateStorage(const WinRateStorage &obj) : states(0) {
+        val = new double [ SIZE ];
+    }
+    
+    // Frees space taken by state array
+    ~WinRateStorage(void){
+        delete[] val;
+    }
 
-        // add # ways of getting a score of one due to Pig Out
-        int num_ones = 0, last_pow = 1, last_choose = 1;
+    // number of states computed into the table by sweep_win_rates so far (see states_computed)
+    std::atomic<long long> states;
 
-        for (int j = 1; j <= i; ++j) {
-            num_ones += last_choose * last_pow;
-            last_pow *= 5;
-            last_choose = last_choose * (i - j + 1) / j;
-        }
+private:
 
-        total_roll_perms_for_sum[i][1] += num_ones;
-        prob_roll_sum[i][1] += (double)num_ones / total_roll_perms[i];
+    double * val; 
+};
 
-        prob_any_roll_sum[1] += prob_roll_sum[i][1] / 8.0;
+// hide from linkage
+namespace {
+    /* DP storage vector. A new WinRateStorage is allocated for each thread spawned to prevent access conflict.
+       Initialized with a single WinRateStorage and resized as required. */
+    std::vector<WinRateStorage> dp(1);
 
-        check_sum += num_ones;
+    /* Computes the win rate of the player about to roll 'r' dice at the pair of scores 'pair' for every
+       turn number and trot flag at once, reading the win rates of all successor states from 'table'
+       (which must already hold them).
 
-        // sum up permutations for getting all other scores
+       The outcomes come from the shared transition table, with swaps and terminal outcomes already
+       resolved. If the opponent moves next, each non-terminal outcome is worth weight * (1 - the opponent's
+       win rate), so the win rate is (win weight + non-terminal weight - a dot product of the weights with
+       the opponent's win rates) / total weight. The dot product is computed by 'dot', the vector
+       kernel selected for this CPU.
 
-        // rolling sum to reduce complexity by m (DICE_SIDES)
-        int rolling = 0;
+       TROT is the Time Trot rule flag, fixed at compile time so the loops over turn and trot have
+       constant bounds. */
+    template<bool TROT>
+    inline void solve_scores(const TransitionTable & trans, GatherDotKernel dot, WinRateStorage & table,
+                int r, int pair, int who) {
 
-        for (int j = DICE_SIDES * i - DICE_SIDES + 1; j < DICE_SIDES * i; ++j) {
-            rolling += total_roll_perms_for_sum[i - 1][j];
-        }
+        // without Time Trot the turn number and trot flag never change from 0
+        const int turns = TROT ? MOD_TROT : 1;
 
-        for (int j = DICE_SIDES * i; j >= 2 * i; --j) {
+        const TransitionTable::Moves & m = trans.moves(pair, r);
+        const unsigned short * next = trans.next() + m.offset;
+        const double * weight = trans.weights(r);
+        double inv_total = trans.inv_total(r);
 
-            // update rolling sum
-            if (j - 1 >= prev_low) rolling -= total_roll_perms_for_sum[i - 1][j - 1];
-            if (j - DICE_SIDES >= prev_low) rolling += total_roll_perms_for_sum[i - 1][j - DICE_SIDES];
+        for (int turn = 0; turn < turns; ++turn) {
+            int next_turn = (TROT && turn < MOD_TROT - 1) ? turn + 1 : 0;
 
-            total_roll_perms_for_sum[i][j] = rolling;
-            check_sum += rolling;
+            // no Time Trot, go to opponent's round
+            double wr = (m.win_weight + m.cont_weight -
+                dot(weight, next, table.plane(1 - who, next_turn, TROT), m.count)) * inv_total;
 
-            prob_roll_sum[i][j] = (double)rolling / total_roll_perms[i];
-            prob_any_roll_sum[j] += prob_roll_sum[i][j] / 10.0;
-        }
+            table.plane(who, turn, 0)[pair] = wr;
 
-        // totals don't match, maybe we have a bug!
-        if (check_sum != total_roll_perms[i])
-            throw "Permutations mismatch in compute_sums";
+            if (TROT) {
+                if (turn == r) {
+                    // apply Time Trot: the same player moves again at (new_score, new_oppo_score)
+                    unsigned short own_next[TransitionTable::MAX_OUTCOMES];
+                    for (int j = 0; j < m.count; ++j) own_next[j] = (unsigned short)trans.flip(next[j]);
+
+                    wr = (m.win_weight + dot(weight, own_next, table.plane(who, next_turn, 0), m.count)) * inv_total;
+                }
+
+                table.plane(who, turn, 1)[pair] = wr;
+            }
+        }
     }
 
-    perms_computed = true;
-}
+    /* Fills 'table' with the win rate of the current player at every state, where 'strat' plays
+       as who = 0 and 'oppo_strat' plays as who = 1.
 
-double prob_full_turn_num_at_score[MAX_TURNS + 1][GOAL][GOAL];
+       Every move strictly increases score + oppo_score (free bacon gives at least 1 point,
+       any roll gives at least 1 point and swapping keeps the sum), so a state only depends on states
+       with a larger score sum. Walking the score sums in descending order thus guarantees all
+       successors of a state are ready before the state itself is computed.
 
-/*
-Part of the final strategy implementation
-Computes the probability of being on a certain time trot turn number at each score. O(n^4) */
-void compute_prob_turn_num_at_score() {
-    // keep track of total probability so we can divide by this to find real probability
+       The states within one score sum are independent of each other, so if 'pool' is given each
+       score sum is split across its threads (this call does the share of 'worker'), which sync
+       before the next one.
 
-    memset(prob_turn_num_at_score, 0, sizeof prob_turn_num_at_score);
-    memset(prob_full_turn_num_at_score, 0, sizeof prob_full_turn_num_at_score);
+       Templated on the concrete strategy types so that the roll lookups of final strategy
+       classes (i.e. MatrixStrategy) are devirtualized and inlined. */
+    template<class Strategy0, class Strategy1, bool TROT>
+    void sweep_win_rates(Strategy0 & strat, Strategy1 & oppo_strat, WinRateStorage & table,
+                int worker, int workers, WorkerPool * pool, GatherDotKernel dot) {
 
-    // base case
+        const TransitionTable & trans = transitions();
 
-    prob_full_turn_num_at_score[0][0][0] = 100.0;
+        // states solved by each call of solve_scores, and by this worker
+        const long long per_call = TROT ? MOD_TROT * 2 : 1;
+        long long states = 0;
 
-    for (int i = 0; i < MAX_TURNS; ++i) {
+        for (int sum = 2 * GOAL - 2; sum >= 0; --sum) {
+            int lo = std::max(0, sum - GOAL + 1), hi = std::min(sum, GOAL - 1);
 
-        for (int j = 0; j < GOAL; ++j) {
-            for (int k = 0; k < GOAL; ++k) {
+            // this worker's share of the scores at this score sum
+            int count = hi - lo + 1;
+            int begin = lo + count * worker / workers, end = lo + count * (worker + 1) / workers;
 
-                if ((j < 2 || k < 2) && i > 3) prob_full_turn_num_at_score[i][j][k] = 0.0;
-                else if (j + k < i) prob_full_turn_num_at_score[i][j][k] = 0.0;
+            for (int score = begin; score < end; ++score) {
+                int oppo_score = sum - score;
+                int pair = TransitionTable::index(score, oppo_score);
 
-                if (prob_full_turn_num_at_score[i][j][k] == 0.0) continue;
+                solve_scores<TROT>(trans, dot, table, strat(score, oppo_score), pair, 0);
+                solve_scores<TROT>(trans, dot, table, oppo_strat(score, oppo_score), pair, 1);
+                states += 2 * per_call;
+            }
 
-                // consider free bacon rule
-                int s = free_bacon(j);
-                int new_score = j + s, new_oppo_score = k;
+            if (pool) pool->sync();
+        }
 
-                add_swap_scores(new_score, new_oppo_score);
+        table.states += states;
+    }
 
-                if (new_oppo_score < GOAL && new_score < GOAL) {
-                    double delta = 0.1 * prob_full_turn_num_at_score[i][j][k];
+    // Runs sweep_win_rates on one thread or, if threads > 1, across the threads of the worker pool of 'slot'
+    template<class Strategy0, class Strategy1, bool TROT>
+    void run_sweep(Strategy0 & strat, Strategy1 & oppo_strat, WinRateStorage & table, int threads, int slot,
+                GatherDotKernel dot) {
+        if (threads <= 1) {
+            sweep_win_rates<Strategy0, Strategy1, TROT>(strat, oppo_strat, table, 0, 1, NULL, dot);
+        }
+        else {
+            WorkerPool & pool = worker_pool(threads, slot);
+            pool.run([&](int worker, int workers) {
+                sweep_win_rates<Strategy0, Strategy1, TROT>(strat, oppo_strat, table, worker, workers, &pool, dot);
+            });
+        }
+    }
 
-                    prob_full_turn_num_at_score[i + 1][new_oppo_score][new_score] += delta;
+    /* Selects the sweep specialized for the current rule set (Swine Swap is resolved by the transition table).
+       The dot products are computed by 'dot', or if it is NULL by the fastest kernel for this CPU.
+       With threads > 1, the sweep runs on the worker pool of 'slot' (the thread id of the table). */
+    template<class Strategy0, class Strategy1>
+    void run_sweep_for_rules(Strategy0 & strat, Strategy1 & oppo_strat, WinRateStorage & table, int threads,
+                int slot = 0, GatherDotKernel dot = NULL) {
+        if (!dot) dot = gather_dot_kernel();
+
+        if (enable_time_trot) run_sweep<Strategy0, Strategy1, true>(strat, oppo_strat, table, threads, slot, dot);
+        else run_sweep<Strategy0, Strategy1, false>(strat, oppo_strat, table, threads, slot, dot);
+    }
+
+    /* Fills 'table' like sweep_win_rates, but instead of following a strategy, who = 0 picks at each pair
+       of scores the roll number maximizing its win rate, and stores these in 'best'. Successors are
+       always final before a state is solved, so one sweep suffices.
+
+       With Time Trot, one roll number must serve every turn number and trot flag at that pair of scores,
+       so the win rates of these are weighted by the probability of reaching them, taken from 'reach'
+       (see compute_reach_probabilities), or equally (with Time Trot allowed) if 'reach' is NULL or
+       the pair of scores is never reached. */
+    template<class Opponent, bool TROT>
+    void sweep_best_response(Opponent & oppo_strat, MatrixStrategy & best, WinRateStorage & table,
+                WinRateStorage * reach) {
+        const TransitionTable & trans = transitions();
+        GatherDotKernel dot = gather_dot_kernel();
+
+        const int turns = TROT ? MOD_TROT : 1;
+
+        for (int sum = 2 * GOAL - 2; sum >= 0; --sum) {
+            int lo = std::max(0, sum - GOAL + 1), hi = std::min(sum, GOAL - 1);
+
+            for (int score = lo; score <= hi; ++score) {
+                int oppo_score = sum - score;
+                int pair = TransitionTable::index(score, oppo_score);
+
+                // weights of the turn numbers and trot flags
+                double weight[MOD_TROT][2] = {};
+                double total_weight = 0.0;
+
+                if (TROT && reach) {
+                    for (int turn = 0; turn < turns; ++turn) {
+                        for (int trot = 0; trot < 2; ++trot) {
+                            weight[turn][trot] = reach->plane(0, turn, trot)[pair];
+                            total_weight += weight[turn][trot];
+                        }
+                    }
                 }
 
-                for (int s = 1; s < std::min(GOAL - j, DICE_SIDES * MAX_ROLLS + 1); ++s) {
-                    if (j + s >= GOAL) break;
+                if (total_weight == 0.0) {
+                    for (int turn = 0; turn < turns; ++turn) weight[turn][TROT] = 1.0;
+                }
 
-                    new_score = j + s; new_oppo_score = k;
+                int best_rolls = 0;
+                double best_wr = -1.0;
 
-                    add_swap_scores(new_score, new_oppo_score);
+                for (int r = 0; r <= MAX_ROLLS; ++r) {
+                    solve_scores<TROT>(trans, dot, table, r, pair, 0);
 
-                    if (new_oppo_score < GOAL && new_score < GOAL) {
-                        double delta = prob_any_roll_sum[s] * prob_full_turn_num_at_score[i][j][k];
+                    double wr = 0.0;
+                    for (int turn = 0; turn < turns; ++turn) {
+                        for (int trot = 0; trot <= (int)TROT; ++trot) {
+                            wr += weight[turn][trot] * table.plane(0, turn, trot)[pair];
+                        }
+                    }
 
-                        prob_full_turn_num_at_score[i + 1][new_oppo_score][new_score] += delta;
+                    if (wr > best_wr) {
+                        best_wr = wr;
+                        best_rolls = r;
                     }
                 }
+
+                // the last roll number tried is still in the table
+                if (best_rolls != MAX_ROLLS) solve_scores<TROT>(trans, dot, table, best_rolls, pair, 0);
+                best.set_roll_num(score, oppo_score, best_rolls);
+
+                solve_scores<TROT>(trans, dot, table, oppo_strat(score, oppo_score), pair, 1);
             }
         }
     }
 
-    for (int j = 0; j < GOAL; ++j) {
-        for (int k = 0; k < GOAL; ++k) {
-            double sum = 0.0;
-
-            for (int i = 0; i <= MAX_TURNS; ++i) {
-                double delta = prob_full_turn_num_at_score[i][j][k];
-                prob_turn_num_at_score[i % MOD_TROT][j][k] += delta;
+    /* Fills 'reach' with the probability of reaching every state (with Time Trot) when who = 0 and
+       who = 1 follow 'policy', averaged over both seatings. 'policy(who, score, oppo_score, turn, trot)'
+       gives the roll number of each state. The reverse of sweep_win_rates: states are visited by
+       ascending score sum, pushing their probability to their successors. */
+    template<class Policy>
+    void compute_reach_probabilities(Policy policy, WinRateStorage & reach) {
+        const TransitionTable & trans = transitions();
+
+        std::fill(reach.plane(0, 0, 0), reach.plane(0, 0, 0) + WinRateStorage::SIZE, 0.0);
+
+        // each seating starts at (0, 0), on turn 0, with Time Trot allowed
+        reach.set(0, 0, 0, 0, 1, 0.5);
+        reach.set(0, 0, 1, 0, 1, 0.5);
+
+        for (int sum = 0; sum <= 2 * GOAL - 2; ++sum) {
+            int lo = std::max(0, sum - GOAL + 1), hi = std::min(sum, GOAL - 1);
+
+            for (int score = lo; score <= hi; ++score) {
+                int pair = TransitionTable::index(score, sum - score);
+
+                for (int who = 0; who < 2; ++who) {
+                    for (int turn = 0; turn < MOD_TROT; ++turn) {
+                        int next_turn = turn < MOD_TROT - 1 ? turn + 1 : 0;
+
+                        for (int trot = 0; trot < 2; ++trot) {
+                            double p = reach.plane(who, turn, trot)[pair];
+                            if (p == 0.0) continue;
+
+                            int r = policy(who, score, sum - score, turn, trot);
+
+                            const TransitionTable::Moves & m = trans.moves(pair, r);
+                            const unsigned short * next = trans.next() + m.offset;
+                            const double * weight = trans.weights(r);
+                            p *= trans.inv_total(r);
+
+                            if (trot && turn == r) {
+                                // Time Trot: the same player moves again, and may not trot next
+                                double * own = reach.plane(who, next_turn, 0);
+                                for (int j = 0; j < m.count; ++j) own[trans.flip(next[j])] += p * weight[j];
+                            }
+                            else {
+                                double * oppo = reach.plane(1 - who, next_turn, 1);
+                                for (int j = 0; j < m.count; ++j) oppo[next[j]] += p * weight[j];
+                            }
+                        }
+                    }
+                }
             }
+        }
+    }
 
-            for (int i = 0; i < MOD_TROT; ++i) {
-                sum += prob_turn_num_at_score[i][j][k];
-            }
+    /* Computes the best response to 'oppo_strat' into 'best', leaving its win rates in 'table'.
+       With Time Trot, the probabilities of reaching each turn number depend on the response itself,
+       so the sweep is repeated with the probabilities under the previous response until it settles. */
+    template<class Opponent>
+    void run_best_response(Opponent & oppo_strat, MatrixStrategy & best, WinRateStorage & table) {
+        // maximum number of sweeps with Time Trot
+        const int MAX_PASSES = 8;
+
+        if (!enable_time_trot) {
+            sweep_best_response<Opponent, false>(oppo_strat, best, table, NULL);
+            return;
+        }
 
-            for (int i = 0; i < MOD_TROT; ++i) {
-                // avoid div by 0
-                if (sum == 0.0)
-                    prob_turn_num_at_score[i][j][k] = 1.0 / MOD_TROT;
-                else
-                    prob_turn_num_at_score[i][j][k] /= sum;
-            }
+        sweep_best_response<Opponent, true>(oppo_strat, best, table, NULL);
+
+        WinRateStorage reach;
+        for (int pass = 1; pass < MAX_PASSES; ++pass) {
+            compute_reach_probabilities([&](int who, int score, int oppo_score, int, int) {
+                return who ? oppo_strat(score, oppo_score) : best(score, oppo_score);
+            }, reach);
+
+            MatrixStrategy prev = best;
+            sweep_best_response<Opponent, true>(oppo_strat, best, table, &reach);
+
+            bool settled = true;
+            for (int i = 0; i < GOAL && settled; ++i)
+                for (int j = 0; j < GOAL && settled; ++j) settled = prev(i, j) == best(i, j);
+
+            if (settled) break;
         }
     }
 
-    turn_num_computed = true;
+    /* Fills dp[t_id] with the win rate of the current player at every state, where 'strat' plays
+       as who = 0 and 'oppo_strat' plays as who = 1. Pairs of MatrixStrategy (nearly all tournament
+       contestants) use a kernel specialized for them; any other strategy goes through IStrategy. */
+    void solve_win_rates(IStrategy & strat, IStrategy & oppo_strat, int t_id, int threads = 1) {
+        MatrixStrategy * mat = dynamic_cast<MatrixStrategy *>(&strat);
+        MatrixStrategy * oppo_mat = dynamic_cast<MatrixStrategy *>(&oppo_strat);
+
+        if (mat && oppo_mat) run_sweep_for_rules(*mat, *oppo_mat, dp[t_id], threads, t_id);
+        else run_sweep_for_rules(strat, oppo_strat, dp[t_id], threads, t_id);
+    }
 }
+    
+/* Computes win rate of one strategy against another at a set of scores (bottom-up DP)
+
+   Params:
+   strategy0, strategy1: the players' strategies (NOT part of the state)
+   thread_id: thread id. Index of DP vector to use for DP storage.
+   threads: number of threads to split the computation of each score sum across.
+
+   The state:
+   score, oppo_score: scores of the players
+   who: player number of the current player
+   turn: current turn number, mod MOD_TROT (needed because of time trot)
+   trot: whether time trot is enabled (will be set to 0 after time trot is applied
+         to ensure time trot is not used twice in a row)
+
+    Time complexity: (N^2 * M^2) where N = goal score, M = max rolls
+    Constant factors to consider: who (2), trot(2), DICE_SIDES(6)
+*/
+double average_win_rate(IStrategy & strategy0, IStrategy & strategy1,
+            int strategy0_plays_as, int score0, int score1, int starting_turn, int thread_id, int threads) {
 
-/* Part of the final strategy implementation
-   Note: this is NOT the procedure for calculating the exact win rate. Look for average_win_rate.
-   
-   Due to special properties of the scores (i.e. the same score cannot occur twice in a game)
-   this function may be written recursively.
+    // precompute permutations, which this depends on, if it has not been computed yet
+    compute_perms();
 
-   Time complexity: O(N^2 * M^2) where N is the goal score, and M is the max # rolls. 
-   Constant factors: DICE_SIDES (6), trot (2) */
-std::pair<double, int> compute_win_rates(int i, int j, int trot) {
+    // the turn number only matters while Time Trot is enabled
+    int turn = enable_time_trot ? starting_turn % MOD_TROT : 0;
 
-    // perform computations if wrs(i, j) has not yet been computed; else return memoized result
-    if (win_rate_at_score[i][j][trot].second == -1) {
+    /* The table is keyed by which strategy is moving (who), not by seat, and a single sweep fills it
+       for both values of who. Seating strategy1 first is therefore just reading the who = 1 state,
+       so both seatings are answered by the same sweep. */
+    solve_win_rates(strategy0, strategy1, thread_id, threads);
 
-        int best_strat = 0;
-        double best_wr = 0.0;
+    double total = 0.0, samp = 0.0;
 
-        for (int r = 0; r <= MAX_ROLLS; ++r) {
-            int total_times_score_counted = 0;
-            double wr = 0.0;
+    if (strategy0_plays_as != 1) { // average of playing as each player
+        total += dp[thread_id].get(score0, score1, 0, turn, enable_time_trot);
+        ++ samp;
+    }
 
-            for (int k = 1; k <= DICE_SIDES * r || r == 0; ++k) {
-                if (r == 0) {
-                    // for zero rolls, set k (the change in score)
-                    // to the value acquired from using the free bacon fule
-                    k = free_bacon(j);
-                }
+    if (strategy0_plays_as != 0) {
+        total += 1 - dp[thread_id].get(score1, score0, 1, turn, enable_time_trot);
+        ++ samp;
+    }
+
+    return total / samp;
+}
 
-                int new_score = i + k, new_oppo_score = j;
-                add_swap_scores(new_score, new_oppo_score);
+// *** Implementation of IncrementalWinRate class ***
 
-                double delta;
-                if (new_score >= GOAL) {
-                    // immediate win, yay
-                    delta = 1.0;
+IncrementalWinRate::IncrementalWinRate(IStrategy & strategy0, IStrategy & strategy1)
+    : table(new WinRateStorage()), changed(2 * TransitionTable::PAIRS, 0), edited(2 * TransitionTable::PAIRS, 0) {
+
+    compute_perms();
+
+    strats[0] = MatrixStrategy(strategy0, "");
+    strats[1] = MatrixStrategy(strategy1, "");
+
+    // summed in order, like the batched kernel (see the class comment)
+    run_sweep_for_rules(strats[0], strats[1], *table, 1, 0, gather_dot_scalar);
+    touched = total_states();
+}
+
+IncrementalWinRate::~IncrementalWinRate() {
+    delete table;
+}
+
+double IncrementalWinRate::win_rate(int strategy0_plays_as, int starting_turn) {
+    int turn = enable_time_trot ? starting_turn % MOD_TROT : 0;
+    double total = 0.0, samp = 0.0;
+
+    if (strategy0_plays_as != 1) {
+        total += table->get(0, 0, 0, turn, enable_time_trot);
+        ++ samp;
+    }
+
+    if (strategy0_plays_as != 0) {
+        total += 1 - table->get(0, 0, 1, turn, enable_time_trot);
+        ++ samp;
+    }
+
+    return total / samp;
+}
+
+MatrixStrategy & IncrementalWinRate::strategy(int who) {
+    return strats[who];
+}
+
+long long IncrementalWinRate::set_roll_num(int who, int score, int oppo_score, int rolls) {
+    if (strats[who](score, oppo_score) == rolls) return 0;
+    strats[who].set_roll_num(score, oppo_score, rolls);
+
+    int pair = TransitionTable::index(score, oppo_score);
+    edited[pair * 2 + who] = 1;
+    return update(score + oppo_score, score + oppo_score);
+}
+
+long long IncrementalWinRate::set_strategy(int who, IStrategy & strat) {
+    MatrixStrategy * mat = dynamic_cast<MatrixStrategy *>(&strat);
+    int top = -1, bottom = 2 * GOAL;
+
+    for (int score = 0; score < GOAL; ++score) {
+        for (int oppo_score = 0; oppo_score < GOAL; ++oppo_score) {
+            int rolls = mat ? mat->get_roll_num(score, oppo_score) : strat(score, oppo_score);
+            if (strats[who](score, oppo_score) == rolls) continue;
+
+            strats[who].set_roll_num(score, oppo_score, rolls);
+            edited[TransitionTable::index(score, oppo_score) * 2 + who] = 1;
+            top = std::max(top, score + oppo_score);
+            bottom = std::min(bottom, score + oppo_score);
+        }
+    }
+
+    return top < 0 ? 0 : update(top, bottom);
+}
+
+long long IncrementalWinRate::update(int top, int bottom) {
+    const TransitionTable & trans = transitions();
+    GatherDotKernel dot = gather_dot_scalar;
+
+    const int turns = enable_time_trot ? MOD_TROT : 1, trots = enable_time_trot ? 2 : 1;
+
+    // the largest increase of the score sum in one move (a move never decreases it)
+    const int max_gain = DICE_SIDES * MAX_ROLLS;
+
+    long long count = 0;
+    std::vector<int> changed_states;
+
+    /* A state only depends on states with a larger score sum (see sweep_win_rates), so walk down the sums
+       from the highest edited cell, recomputing the edited states and those with a changed successor.
+       Once past the lowest edited cell and nothing has changed over the whole range of sums one move
+       can span, no lower state can be affected. */
+    int last_change = top;
+
+    for (int sum = top; sum >= 0 && (sum >= bottom || last_change - sum <= max_gain); --sum) {
+        int lo = std::max(0, sum - GOAL + 1), hi = std::min(sum, GOAL - 1);
+
+        for (int s = lo; s <= hi; ++s) {
+            int pair = TransitionTable::index(s, sum - s);
+
+            for (int w = 0; w < 2; ++w) {
+                int r = strats[w](s, sum - s);
+                bool recompute = edited[pair * 2 + w] != 0;
+
+                // states at the highest score sum never depend on each other, so only the edited ones change there
+                if (!recompute && sum < top) {
+                    const TransitionTable::Moves & m = trans.moves(pair, r);
+                    const unsigned short * next = trans.next() + m.offset;
+                    for (int j = 0; j < m.count; ++j) {
+                        // the opponent's state at the successor, or with Time Trot this player's own
+                        if (changed[next[j] * 2 + 1 - w] ||
+                            (enable_time_trot && changed[trans.flip(next[j]) * 2 + w])) {
+                            recompute = true;
+                            break;
+                        }
+                    }
                 }
 
-                else if (new_oppo_score >= GOAL) {
-                    // immediate loss due to swapping! we need to avoid this
-                    delta = 0.0;
+                if (!recompute) continue;
+                edited[pair * 2 + w] = 0;
+
+                double old[MOD_TROT * 2];
+                for (int turn = 0; turn < turns; ++turn)
+                    for (int trot = 0; trot < trots; ++trot) old[turn * 2 + trot] = table->plane(w, turn, trot)[pair];
+
+                if (enable_time_trot) solve_scores<true>(trans, dot, *table, r, pair, w);
+                else solve_scores<false>(trans, dot, *table, r, pair, w);
+                count += turns * trots;
+
+                bool diff = false;
+                for (int turn = 0; turn < turns; ++turn)
+                    for (int trot = 0; trot < trots; ++trot)
+                        if (old[turn * 2 + trot] != table->plane(w, turn, trot)[pair]) diff = true;
+
+                if (diff) {
+                    changed[pair * 2 + w] = 1;
+                    changed_states.push_back(pair * 2 + w);
+                    last_change = sum;
                 }
+            }
+        }
+    }
 
-                else {
-                    // no one wins, add win rate at next round
-                    if (trot) {
-                        // use Time Trot
+    for (size_t i = 0; i < changed_states.size(); ++i) changed[changed_states[i]] = 0;
 
-                        double trot_prob = 0.0;
+    touched += count;
+    return count;
+}
 
-                        if (r < MOD_TROT) trot_prob = prob_turn_num_at_score[r][i][j];
+long long IncrementalWinRate::states_touched() const {
+    return touched;
+}
+
+long long IncrementalWinRate::total_states() {
+    return 2LL * TransitionTable::PAIRS * (enable_time_trot ? MOD_TROT * 2 : 1);
+}
 
-                        delta =
-                            (1.0 - compute_win_rates(new_oppo_score, new_score, 1).first) * (1 - trot_prob) +
-                            compute_win_rates(new_score, new_oppo_score, 0).first * trot_prob;
+// hide from linkage
+namespace {
+    /* Solves the game for optimal play by both players: at each state the player moving picks the roll
+       number maximizing its win rate, separately for each turn number and trot flag, and stores it
+       in 'policy'. Both players then have the same win rates, so the who = 0 and who = 1 planes are
+       kept equal and solve_scores is used unchanged. One sweep suffices (see sweep_win_rates). */
+    template<bool TROT>
+    void sweep_optimal(TurnPolicy & policy, WinRateStorage & table) {
+        const TransitionTable & trans = transitions();
+        GatherDotKernel dot = gather_dot_kernel();
+
+        const int turns = TROT ? MOD_TROT : 1, trots = TROT ? 2 : 1;
+
+        for (int sum = 2 * GOAL - 2; sum >= 0; --sum) {
+            int lo = std::max(0, sum - GOAL + 1), hi = std::min(sum, GOAL - 1);
+
+            for (int score = lo; score <= hi; ++score) {
+                int oppo_score = sum - score;
+                int pair = TransitionTable::index(score, oppo_score);
+
+                double best_wr[MOD_TROT][2] = {};
+                int best_rolls[MOD_TROT][2] = {};
+
+                for (int r = 0; r <= MAX_ROLLS; ++r) {
+                    solve_scores<TROT>(trans, dot, table, r, pair, 0);
+
+                    for (int turn = 0; turn < turns; ++turn) {
+                        for (int trot = 0; trot < trots; ++trot) {
+                            double wr = table.plane(0, turn, trot)[pair];
+                            if (r == 0 || wr > best_wr[turn][trot]) {
+                                best_wr[turn][trot] = wr;
+                                best_rolls[turn][trot] = r;
+                            }
+                        }
                     }
-                    else {
-                        // no Time Trot allowed
-                        delta = 1.0 - compute_win_rates(new_oppo_score, new_score, 1).first;
+                }
+
+                for (int turn = 0; turn < MOD_TROT; ++turn) {
+                    for (int trot = 0; trot < 2; ++trot) {
+                        // without Time Trot, the turn number and trot flag do not matter
+                        int t = TROT ? turn : 0, tr = TROT ? trot : 0;
+
+                        if (turn < turns && trot < trots) {
+                            table.plane(0, turn, trot)[pair] = table.plane(1, turn, trot)[pair] = best_wr[t][tr];
+                        }
+                        policy.set_roll_num(score, oppo_score, turn, trot, best_rolls[t][tr]);
                     }
                 }
+            }
+        }
+    }
 
-                if (r == 0) { // special stuff for Free Bacon (0 rolls)
+    /* Picks the roll number of 'strat' at each pair of scores for a player who cannot see the turn number,
+       given the optimal policy and win rates in 'table' (see sweep_optimal): the roll number maximizing
+       the win rate over the turn numbers and trot flags, weighted by their probability of being reached
+       under optimal play (equally, with Time Trot allowed, where the pair of scores is never reached).
+
+       Like sweep_optimal this is a bottom-up sweep, but the win rates of successors are those of 'strat'
+       playing itself rather than the optimal ones, which it cannot achieve; this makes 'strat' much
+       harder to exploit. 'table' is left holding the win rates of 'strat' against itself. */
+    void project_policy(const TurnPolicy & policy, WinRateStorage & table, MatrixStrategy & strat) {
+        if (!enable_time_trot) {
+            for (int i = 0; i < GOAL; ++i)
+                for (int j = 0; j < GOAL; ++j) strat.set_roll_num(i, j, policy(i, j, 0, 0));
+            return;
+        }
 
-                    // the win rate for free bacon = delta
-                    wr = delta;
+        const TransitionTable & trans = transitions();
+        GatherDotKernel dot = gather_dot_kernel();
 
-                    // set to 1 to ignore total_times_score_counted
-                    total_times_score_counted = 1;
+        WinRateStorage reach;
+        compute_reach_probabilities([&](int, int score, int oppo_score, int turn, int trot) {
+            return policy(score, oppo_score, turn, trot);
+        }, reach);
 
-                    break; // no need to continue
-                }
+        for (int sum = 2 * GOAL - 2; sum >= 0; --sum) {
+            int lo = std::max(0, sum - GOAL + 1), hi = std::min(sum, GOAL - 1);
 
-                else { // every other roll #
+            for (int score = lo; score <= hi; ++score) {
+                int pair = TransitionTable::index(score, sum - score);
 
-                    wr += delta * total_roll_perms_for_sum[r][k];
+                // both players follow the same policy, so their probabilities add up
+                double weight[MOD_TROT][2];
+                double total_weight = 0.0;
 
-                    // add to total so we can divide by this later.
-                    total_times_score_counted += total_roll_perms_for_sum[r][k];
+                for (int turn = 0; turn < MOD_TROT; ++turn) {
+                    for (int trot = 0; trot < 2; ++trot) {
+                        weight[turn][trot] = reach.plane(0, turn, trot)[pair] + reach.plane(1, turn, trot)[pair];
+                        total_weight += weight[turn][trot];
+                    }
                 }
 
-                if (k == 1) k = 2 * r - 1; // skip unnecessary computations
-            }
+                if (total_weight == 0.0) {
+                    for (int turn = 0; turn < MOD_TROT; ++turn) weight[turn][1] = 1.0;
+                }
 
-            wr /= total_times_score_counted;
+                int best_rolls = 0;
+                double best_wr = -1.0;
 
-            if (wr > best_wr) {
-                best_wr = wr;
-                best_strat = r;
+                for (int r = 0; r <= MAX_ROLLS; ++r) {
+                    solve_scores<true>(trans, dot, table, r, pair, 0);
+
+                    double wr = 0.0;
+                    for (int turn = 0; turn < MOD_TROT; ++turn)
+                        for (int trot = 0; trot < 2; ++trot) wr += weight[turn][trot] * table.plane(0, turn, trot)[pair];
+
+                    if (wr > best_wr) {
+                        best_wr = wr;
+                        best_rolls = r;
+                    }
+                }
+
+                // continue with the win rates of the strategy playing itself (the who = 1 planes are kept equal)
+                solve_scores<true>(trans, dot, table, best_rolls, pair, 0);
+                for (int turn = 0; turn < MOD_TROT; ++turn)
+                    for (int trot = 0; trot < 2; ++trot) table.plane(1, turn, trot)[pair] = table.plane(0, turn, trot)[pair];
+
+                strat.set_roll_num(score, sum - score, best_rolls);
             }
         }
-
-        win_rate_at_score[i][j][trot] = std::pair<double, int>(best_wr, best_strat);
     }
-
-    return win_rate_at_score[i][j][trot];
 }
 
-// Compute the "final strategy" and return a MatrixStrategy containing the roll number for each score
-MatrixStrategy * create_final_strat(bool quiet) {
-    std::pair<double, int> default_val = std::pair<double, int>(-1.0, -1);
-    std::fill(win_rate_at_score[0][0], win_rate_at_score[0][0] + GOAL * GOAL * 2, default_val);
+// *** Implementation of TurnPolicy class ***
 
-    // precompute stuff
-    if (!quiet) {
-        std::cout << "\n";
+void TurnPolicy::write_to_file(std::string path) {
+    std::ofstream ofs(path);
 
-        std::cout << "Preparing 0/2, please wait ..." << std::endl;
+    ofs << "policy " << MOD_TROT << "\n";
+
+    for (int turn = 0; turn < MOD_TROT; ++turn) {
+        for (int trot = 0; trot < 2; ++trot) {
+            ofs << "turn " << turn << " trot " << trot << "\n";
+
+            for (int i = 0; i < GOAL; ++i) {
+                for (int j = 0; j < GOAL; ++j) {
+                    ofs << (*this)(i, j, turn, trot) << " ";
+                }
+                ofs << "\n";
+            }
+        }
     }
 
-    // precompute dice permulations used in the other functions
+    ofs.flush();
+    ofs.close();
+}
+
+/* Compute the "final" strategy: the exact optimal play, solved bottom-up over the full state
+   (score, oppo_score, turn mod MOD_TROT, trot). Returns a MatrixStrategy containing the roll number
+   for each score (see project_policy) and, if 'policy' is given, fills it with the optimal roll number
+   of every state.
 
-    if (!perms_computed) compute_perms();
+   Time complexity: O(N^2 * M^2) where N is the goal score, and M is the max # rolls.
+   Constant factors: MOD_TROT (5), trot (2), DICE_SIDES (6) */
+MatrixStrategy * create_final_strat(bool quiet, TurnPolicy * policy, int thread_id) {
+    compute_perms();
 
-    if (!quiet) std::cout << "Preparing 1/2, please wait ..." << std::endl;
+    if (!quiet) std::cout << "\nComputing strategy..." << std::endl;
 
-    // precompute the probability of being on a specific turn number at each score; used for Time Trot rule
+    TurnPolicy * opt_policy = policy ? policy : new TurnPolicy();
+    WinRateStorage & table = dp[thread_id];
 
-    if (!turn_num_computed) compute_prob_turn_num_at_score();
+    if (enable_time_trot) sweep_optimal<true>(*opt_policy, table);
+    else sweep_optimal<false>(*opt_policy, table);
 
-    if (!quiet)
-        std::cout << "Preparing 2/2...\n\nComputing strategy..." << std::endl;
+    double opt_wr = table.get(0, 0, 0, 0, enable_time_trot);
 
-    // make a CachedStrategy in the heap to store our strategy matrix. We will return this at the end.
+    // make a MatrixStrategy in the heap to store our strategy matrix. We will return this at the end.
     MatrixStrategy * opt_strat = new MatrixStrategy("_final");
+    project_policy(*opt_policy, table, *opt_strat);
 
-    for (int i = 0; i < GOAL; ++i) {
-        for (int j = 0; j < GOAL; ++j) {
-            if (j % 4 == 0 || i % 4 == 0){
-                opt_strat->set_roll_num(i, j, 4);
-            }
-            else{
-                opt_strat->set_roll_num(i, j, compute_win_rates(i, j, 1).second);
-            }
-        }
+    if (!quiet) {
+        std::cout << "Win rate of the first player under optimal play: " << opt_wr << std::endl;
+        std::cout << "Strategy saved\n" << std::endl;
     }
 
-    if (!quiet)
-        std::cout << "Strategy saved\n" << std::endl;
+    if (!policy) delete opt_policy;
 
     // return the complete strategy
     return opt_strat;
 }
 
+// Compute the best response to a strategy and return a MatrixStrategy containing the roll number for each score
+MatrixStrategy * create_best_response(IStrategy & oppo_strat, bool quiet, int thread_id) {
+    compute_perms();
 
-// *** Win rate computations ***
+    MatrixStrategy * best = new MatrixStrategy("_bestresponse");
+    MatrixStrategy * oppo_mat = dynamic_cast<MatrixStrategy *>(&oppo_strat);
+
+    WinRateStorage & table = dp[thread_id];
+
+    if (oppo_mat) run_best_response(*oppo_mat, *best, table);
+    else run_best_response(oppo_strat, *best, table);
+
+    if (!quiet) {
+        std::cout << "\nBest response computed. Win rate: " <<
+            (table.get(0, 0, 0, 0, enable_time_trot) + 1 - table.get(0, 0, 1, 0, enable_time_trot)) / 2 << std::endl;
+    }
+
+    return best;
+}
+
+// *** Batched win rate computations ***
 
 // hide from linkage
 namespace {
-    // storage class for win rate computation DP	
-    class WinRateStorage{
-        
-    public:	
-        const static int SIZE = GOAL * GOAL * 2 * MOD_TROT * 2;
-        
-        // get the value stored for a specified state
-        inline double get(int score, int oppo_score, int who, int turn, int trot){
-            return val[index(score, oppo_score, who, turn, trot)];
-        }
-
-        // set the value stored for a specified state to 'value'
-        inline void set(int score, int oppo_score, int who, int turn, int trot, double value){
-            val[index(score, oppo_score, who, turn, trot)] = value;
+    static_assert(WIN_RATE_BATCH == GATHER_LANES, "one opponent per lane of the gather-lanes kernel");
+
+    /* storage class for the batched win rate DP. Each state holds WIN_RATE_BATCH values (lanes),
+       one per opponent. States are stored as one plane per (who, trot), indexed by pair of scores;
+       each entry holds the lanes of every turn number contiguously, so that the successors of a state
+       for all turn numbers are read together. */
+    class BatchWinRateStorage{
+
+    public:
+        // number of values per entry of a plane
+        const static int STRIDE = MOD_TROT * WIN_RATE_BATCH;
+        const static int SIZE = GOAL * GOAL * 2 * 2 * STRIDE;
+
+        // get the plane holding the states with the specified who and trot
+        inline double * plane(int who, int trot) {
+            return val + (who * 2 + trot) * GOAL * GOAL * STRIDE;
         }
 
-        // set all values to -1 in preparation for a new win rate calculation
-        inline void clear(void) {
-            std::fill(val, val + SIZE, -1.0);
+        // get the lanes of the state with the specified who, trot, pair of scores and turn
+        inline double * lanes(int who, int trot, int pair, int turn) {
+            return plane(who, trot) + pair * STRIDE + turn * WIN_RATE_BATCH;
         }
 
-        // Default constructor, allocates space for state array
-        WinRateStorage(void){
-            val = new double [ SIZE ];
+        /* Default constructor. The state array (SIZE doubles, about 13 MB) is only allocated by allocate(),
+           so that threads which never run a batched computation do not pay for it. */
+        BatchWinRateStorage(void) : states(0), val(NULL) {
         }
 
         /* Copy constructor does NOT actually copy the old array.
            Definined like this to make vector.resize work. */
-        WinRateStorage(const WinRateStorage &obj){
-            val = new double [ SIZE ];
+        BatchWinRateStorage(const BatchWinRateStorage &obj) : states(0), val(NULL) {
         }
-        
+
+        // Allocates the state array, if that has not been done yet
+        void allocate() {
+            if (!val) val = new double [ SIZE ];
+        }
+
         // Frees space taken by state array
-        ~WinRateStorage(void){
+        ~BatchWinRateStorage(void){
             delete[] val;
         }
 
+        // number of states computed into the table so far, counting every lane (see states_computed)
+        std::atomic<long long> states;
+
     private:
 
-        double * val; 
+        double * val;
+    };
 
-        static inline int index(int score, int oppo_score, int who, int turn, int trot) {
-            return score * GOAL * 2 * MOD_TROT * 2 + oppo_score * 2 * MOD_TROT * 2 +
-                who * MOD_TROT * 2 + turn * 2 + trot;
-        }
+    // DP storage vector for batched computations, one per thread (see dp)
+    std::vector<BatchWinRateStorage> batch_dp(1);
 
-    };
+    /* Batched version of solve_scores: lane l of each state belongs to the l-th opponent, which rolls
+       rolls[l] dice at this state. Lanes rolling the same number of dice share their outcomes, so they are
+       computed together by one gather-lanes pass, which also covers all turn numbers at once.
+       If the common strategy is moving, that is all the lanes. */
+    template<bool TROT>
+    inline void solve_scores_batch(const TransitionTable & trans, GatherLanesKernel lanes_dot,
+                BatchWinRateStorage & table, const int * rolls, int pair, int who) {
 
-    /* DP storage vector. A new WinRateStorage is allocated for each thread spawned to prevent access conflict.
-       Initialized with a single WinRateStorage and resized as required. */
-    std::vector<WinRateStorage> dp(1);
+        const int L = WIN_RATE_BATCH;
 
-    // coroutine for average win rate calculator
-    double average_win_rate_coroutine(IStrategy & strat, IStrategy & oppo_strat, int score, int oppo_scoe,
-                int who, int turn, int trot, int t_id) {
+        // without Time Trot the turn number and trot flag never change from 0
+        const int turns = TROT ? MOD_TROT : 1;
 
-        if (dp[t_id].get(score, oppo_scoe, who, turn, trot) == -1.0) {
+        // lanes still to be computed
+        bool pending[L];
+        std::fill(pending, pending + L, true);
 
-            int r = strat(score, oppo_scoe);
-            
-            int total_times_score_counted = 0;
-            double wr = 0.0;
+        for (int first = 0; first < L; ++first) {
+            if (!pending[first]) continue;
 
-            for (int k = 1; k <= DICE_SIDES * r || r == 0; ++k) {
-                if (r == 0) {
-                    // for zero rolls, set k (the change in score)
-                    // to the value acquired from using the free bacon fule
-                    k = free_bacon(oppo_scoe);
-                }
+            // the lanes rolling the same number of dice as lane 'first'
+            int r = rolls[first];
+            bool lane[L];
+            for (int l = 0; l < L; ++l) {
+                lane[l] = pending[l] && rolls[l] == r;
+                if (lane[l]) pending[l] = false;
+            }
 
-                int new_score = score + k, new_oppo_score = oppo_scoe;
-                add_swap_scores(new_score, new_oppo_score);
+            const TransitionTable::Moves & m = trans.moves(pair, r);
+            const unsigned short * next = trans.next() + m.offset;
+            const double * weight = trans.weights(r);
+            double inv_total = trans.inv_total(r);
 
-                double delta;
-                if (new_score >= GOAL) {
-                    // immediate win, yay
-                    delta = 1.0;
-                }
+            // no Time Trot, go to opponent's round: acc[t] holds the dot products at opponent turn number t
+            double acc[MOD_TROT * L];
+            lanes_dot(weight, next, table.plane(1 - who, TROT), BatchWinRateStorage::STRIDE, turns, m.count, acc);
+
+            for (int turn = 0; turn < turns; ++turn) {
+                int next_turn = (TROT && turn < MOD_TROT - 1) ? turn + 1 : 0;
 
-                else if (new_oppo_score >= GOAL) {
-                    // immediate loss due to swapping! we need to avoid this
-                    delta = 0.0;
+                double * out = table.lanes(who, 0, pair, turn);
+                for (int l = 0; l < L; ++l) {
+                    if (lane[l]) out[l] = (m.win_weight + m.cont_weight - acc[next_turn * L + l]) * inv_total;
                 }
 
-                else {
-                    // no one wins, add win rate at next round
+                if (TROT) {
+                    double * trot_out = table.lanes(who, 1, pair, turn);
+                    double * src = out;
+                    double own_acc[L];
 
-                    if (enable_time_trot && trot && turn == r) {
-                        // apply Time Trot
-                        delta =
-                            average_win_rate_coroutine(strat, oppo_strat, 
-                                new_score, new_oppo_score, who, (turn + 1) % MOD_TROT, 0, t_id);
+                    if (turn == r) {
+                        // apply Time Trot: the same player moves again at (new_score, new_oppo_score)
+                        unsigned short own_next[TransitionTable::MAX_OUTCOMES];
+                        for (int j = 0; j < m.count; ++j) own_next[j] = (unsigned short)trans.flip(next[j]);
+
+                        lanes_dot(weight, own_next, table.plane(who, 0) + next_turn * L,
+                            BatchWinRateStorage::STRIDE, 1, m.count, own_acc);
+
+                        for (int l = 0; l < L; ++l) own_acc[l] = (m.win_weight + own_acc[l]) * inv_total;
+                        src = own_acc;
                     }
-                    else {
-                        // no Time Trot, go to opponent's round
-                        delta = 1.0 - average_win_rate_coroutine(oppo_strat, strat,
-                            new_oppo_score, new_score, 1-who, 
-                            (enable_time_trot * (turn + 1)) % MOD_TROT, enable_time_trot, t_id); 
+
+                    for (int l = 0; l < L; ++l) {
+                        if (lane[l]) trot_out[l] = src[l];
                     }
                 }
+            }
+        }
+    }
 
-                if (r == 0) { // special stuff for Free Bacon (0 rolls)
+    /* Batched version of sweep_win_rates: 'strat' plays as who = 0 in every lane, and opponents[l]
+       plays as who = 1 in lane l. */
+    template<class Strategy0, class Opponent, bool TROT>
+    void sweep_win_rates_batch(Strategy0 & strat, Opponent * const * opponents, BatchWinRateStorage & table,
+                int worker, int workers, WorkerPool * pool) {
 
-                    // the win rate for free bacon = delta
-                    wr = delta;
+        const TransitionTable & trans = transitions();
+        GatherLanesKernel lanes_dot = gather_lanes_kernel();
 
-                    // set to 1 to ignore total_times_score_counted
-                    total_times_score_counted = 1;
+        int rolls[WIN_RATE_BATCH];
 
-                    break; // no need to continue
-                }
+        // states solved by each call of solve_scores_batch, and by this worker
+        const long long per_call = (TROT ? MOD_TROT * 2 : 1) * WIN_RATE_BATCH;
+        long long states = 0;
 
-                else { // every other roll #
+        for (int sum = 2 * GOAL - 2; sum >= 0; --sum) {
+            int lo = std::max(0, sum - GOAL + 1), hi = std::min(sum, GOAL - 1);
 
-                    wr += delta * total_roll_perms_for_sum[r][k];
+            // this worker's share of the scores at this score sum
+            int count = hi - lo + 1;
+            int begin = lo + count * worker / workers, end = lo + count * (worker + 1) / workers;
 
-                    // add to total so we can divide by this later.
-                    total_times_score_counted += total_roll_perms_for_sum[r][k];
-                }
+            for (int score = begin; score < end; ++score) {
+                int oppo_score = sum - score;
+                int pair = TransitionTable::index(score, oppo_score);
 
-                if (k == 1) k = 2 * r - 1; // skip unnecessary computations
-            }
+                std::fill(rolls, rolls + WIN_RATE_BATCH, strat(score, oppo_score));
+                solve_scores_batch<TROT>(trans, lanes_dot, table, rolls, pair, 0);
 
-            wr /= total_times_score_counted;
+                for (int l = 0; l < WIN_RATE_BATCH; ++l) rolls[l] = (*opponents[l])(score, oppo_score);
+                solve_scores_batch<TROT>(trans, lanes_dot, table, rolls, pair, 1);
+                states += 2 * per_call;
+            }
 
-            dp[t_id].set(score, oppo_scoe, who, turn, trot, wr);
+            if (pool) pool->sync();
         }
 
-        return dp[t_id].get(score, oppo_scoe, who, turn, trot);
+        table.states += states;
+    }
+
+    // Runs sweep_win_rates_batch for the current rule set, on one thread or across the worker pool
+    template<class Strategy0, class Opponent>
+    void run_sweep_batch(Strategy0 & strat, Opponent * const * opponents, BatchWinRateStorage & table, int threads, int slot) {
+        auto sweep = [&](int worker, int workers, WorkerPool * pool) {
+            if (enable_time_trot)
+                sweep_win_rates_batch<Strategy0, Opponent, true>(strat, opponents, table, worker, workers, pool);
+            else
+                sweep_win_rates_batch<Strategy0, Opponent, false>(strat, opponents, table, worker, workers, pool);
+        };
+
+        if (threads <= 1) {
+            sweep(0, 1, NULL);
+        }
+        else {
+            WorkerPool & pool = worker_pool(threads, slot);
+            pool.run([&](int worker, int workers) { sweep(worker, workers, &pool); });
+        }
     }
 }
-    
-/* Recursively computes win rate of one strategy against another at a set of scores (memoized)
 
-   Params:
-   strat, oppo_strat: keep track of the players' strategies (NOT part of the state)
-   thread_id: thread id. Index of DP vector to use for DP storage.
+/* Computes the win rates of one strategy against up to WIN_RATE_BATCH opponents in a single sweep of the
+   state space. The values of the states are vectors holding one lane per opponent; wherever strategy0 is
+   moving all lanes share the same outcomes, so the work is far less than one sweep per opponent.
+   Unused lanes are filled with copies of the first opponent. */
+void average_win_rates(IStrategy & strategy0, const std::vector<IStrategy *> & opponents, double * win_rates,
+            int strategy0_plays_as, int thread_id, int threads) {
+
+    // evaluate larger groups one batch at a time
+    for (size_t b = WIN_RATE_BATCH; b < opponents.size(); b += WIN_RATE_BATCH) {
+        std::vector<IStrategy *> part(opponents.begin() + b,
+            opponents.begin() + std::min(b + WIN_RATE_BATCH, opponents.size()));
+        average_win_rates(strategy0, part, win_rates + b, strategy0_plays_as, thread_id, threads);
+    }
+    if (opponents.empty()) return;
 
-   The state:
-   score, oppo_score: scores of the players
-   who: player number of the current player
-   turn: current turn number, mod 8 (needed because of time trot)
-   trot: whether time trot is enabled (will be set to 0 after time trot is applied
-         to ensure time trot is not used twice in a row)
+    compute_perms();
 
-    Time complexity: (N^2 * M^2) where N = goal score, M = max rolls
-    Constant factors to consider: who (2), trot(2), DICE_SIDES(6)
-*/
-double average_win_rate(IStrategy & strategy0, IStrategy & strategy1,
-            int strategy0_plays_as, int score0, int score1, int starting_turn, int thread_id) {
+    IStrategy * lanes[WIN_RATE_BATCH];
+    MatrixStrategy * mat_lanes[WIN_RATE_BATCH];
+    bool all_mat = dynamic_cast<MatrixStrategy *>(&strategy0) != NULL;
 
-    // precompute permutations, which this depends on, if it has not been computed yet
-    if (!perms_computed) compute_perms();
+    for (int l = 0; l < WIN_RATE_BATCH; ++l) {
+        lanes[l] = opponents[l < (int)opponents.size() ? l : 0];
+        mat_lanes[l] = dynamic_cast<MatrixStrategy *>(lanes[l]);
+        if (!mat_lanes[l]) all_mat = false;
+    }
 
-    // init dp array
-    dp[thread_id].clear();
+    BatchWinRateStorage & table = batch_dp[thread_id];
+    table.allocate();
 
-    double total = 0.0, samp = 0.0;
+    if (all_mat) run_sweep_batch(*dynamic_cast<MatrixStrategy *>(&strategy0), mat_lanes, table, threads, thread_id);
+    else run_sweep_batch(strategy0, lanes, table, threads, thread_id);
 
-    if (strategy0_plays_as != 1) { // average of playing as each player
-        total += average_win_rate_coroutine(strategy0, strategy1, score0, score1, 0,
-            starting_turn, enable_time_trot, thread_id);
+    int pair = TransitionTable::index(0, 0);
+    int count = std::min((int)opponents.size(), WIN_RATE_BATCH);
 
-        // init dp array
-        dp[thread_id].clear();
-        ++ samp;
-    }
+    for (int l = 0; l < count; ++l) {
+        double total = 0.0, samp = 0.0;
 
-    if (strategy0_plays_as != 0) {
-        total += 1 - average_win_rate_coroutine(strategy1, strategy0, score1, score0, 0,
-            starting_turn, enable_time_trot, thread_id);
+        if (strategy0_plays_as != 1) {
+            total += table.lanes(0, enable_time_trot, pair, 0)[l];
+            ++ samp;
+        }
 
-        ++ samp;
+        if (strategy0_plays_as != 0) {
+            total += 1 - table.lanes(1, enable_time_trot, pair, 0)[l];
+            ++ samp;
+        }
+
+        win_rates[l] = total / samp;
     }
+}
 
-    return total / samp;
+// Allocates DP storage for thread ids 0 .. threads - 1
+void resize_win_rate_storage(int threads) {
+    dp.resize(threads);
+    batch_dp.resize(threads);
+}
+
+long long states_computed(int thread_id) {
+    return dp[thread_id].states + batch_dp[thread_id].states;
 }
 
 // compute the average win rate by sampling (i.e. playing lots of games)
@@ -633,126 +1149,99 @@ double average_win_rate_by_sampling(IStrategy & strategy0, IStrategy & strategy1
     return (double)wins / samples;
 }
 
-// hide from linkage
-namespace {
-    // sorts by wins in descending order, then sorts by names alphabetically
-    bool wins_comparer(const std::pair<int, std::string> & a, const std::pair<int, std::string> & b) {
-        if (a.first > b.first) return true;
-        else if (a.first < b.first) return false;
-        else return a.second < b.second;
+// *** Reachability ***
+
+/* Forward pass over the states by ascending score sum, as in compute_reach_probabilities, but only tracking
+   whether each state can be reached. The strategy's own moves are followed exactly; the opponent may
+   roll any number of dice. (Where the opponent may trot, it is also assumed to pass the turn with
+   any roll number, which can only mark more states.) */
+void mask_unreachable(MatrixStrategy & strat) {
+    const TransitionTable & trans = transitions();
+
+    /* reach[who][pair]: the reachable turn numbers and trot flags at a pair of scores,
+       bit turn * 2 + trot; who = 0 when 'strat' is to move */
+    std::vector<unsigned short> reach[2];
+    reach[0].assign(TransitionTable::PAIRS, 0);
+    reach[1].assign(TransitionTable::PAIRS, 0);
+
+    // without Time Trot the turn number does not matter, so every state is kept on turn 0
+    int start_trot = enable_time_trot ? 1 : 0;
+
+    // after[m]: the states reached when the turn passes from the turn numbers in bit mask m
+    unsigned short after[1 << MOD_TROT];
+    for (int m = 0; m < 1 << MOD_TROT; ++m) {
+        after[m] = 0;
+        for (int turn = 0; turn < MOD_TROT; ++turn) {
+            int next_turn = enable_time_trot && turn < MOD_TROT - 1 ? turn + 1 : 0;
+            if (m >> turn & 1) after[m] |= 1 << (next_turn * 2 + start_trot);
+        }
     }
 
-    // multithreading stuff
-    std::mutex mtx;
-    std::condition_variable announcer_cv;
-    bool announcer_lock = false;
-
-    // coroutine for the round-robin tournament procedure
-    void round_robin_coroutine(std::vector<std::pair<std::string, IStrategy *> > * strats,
-        void announcer(int games_played, int games_remaining, int high, std::string high_strat),
-        int announcer_interval, double margin, double ** win_rate_mat,
-        volatile int * interrupt, 
-            int * high, int * high_strat, std::vector<std::pair<int,std::string>> * victories, int * games_played,
-            int jbase, int jdelta) {
-
-        size_t N = strats->size();
-
-        int total_games = N * (N - 1) / 2;
-
-        for (unsigned i = 0; i < N; ++i){
-            // interrupt not null & set
-            if (interrupt && *interrupt) break;
-
-            for (unsigned j = i + 1 + jbase; j < N; j += jdelta){
-                if (interrupt && *interrupt) break;
-
-                std::string name0 = strats->at(i).first, name1 = strats->at(j).first;
-                IStrategy * strat0 = strats->at(i).second, * strat1 = strats->at(j).second;
-
-                double avr = average_win_rate(*strat0, *strat1, -1, 0, 0, 0, jbase);
-
-                if (win_rate_mat) {
-                    win_rate_mat[i][j] = avr;
-                    win_rate_mat[j][i] = 1.0 - avr;
-                }
-
-                int winner = -1;
-
-                if (avr > margin)
-                    winner = i;
-                else if (avr < 1.0 - margin)
-                    winner = j;
+    // the turn numbers in a set of states
+    auto turns = [](unsigned short states) {
+        int m = 0;
+        for (int turn = 0; turn < MOD_TROT; ++turn) {
+            if (states >> (turn * 2) & 3) m |= 1 << turn;
+        }
+        return m;
+    };
 
-                if (winner != -1) {
-                    ++victories->at(winner).first;
-                    if (victories->at(winner).first > (*high)) {
-                        (*high) = victories->at(winner).first;
-                        (*high_strat) = winner;
-                    }
-                }
+    reach[0][TransitionTable::index(0, 0)] = 1 << start_trot;
+    reach[1][TransitionTable::index(0, 0)] = 1 << start_trot;
 
-                ++(*games_played);
+    for (int sum = 0; sum <= 2 * GOAL - 2; ++sum) {
+        int lo = std::max(0, sum - GOAL + 1), hi = std::min(sum, GOAL - 1);
 
-                if ((*games_played) % announcer_interval == 0 && announcer != NULL) {
-                    std::unique_lock<std::mutex> lck(mtx);
-                    while (announcer_lock) announcer_cv.wait(lck);
+        for (int score = lo; score <= hi; ++score) {
+            int pair = TransitionTable::index(score, sum - score);
 
-                    announcer_lock = true;
+            // the strategy moves
+            unsigned short own = reach[0][pair];
+            if (own) {
+                int r = strat(score, sum - score);
+                const TransitionTable::Moves & m = trans.moves(pair, r);
+                const unsigned short * next = trans.next() + m.offset;
 
-                    announcer(*games_played, total_games - *games_played, *high, strats->at(* high_strat).first);
+                // rolling the turn number with trot allowed, it moves again
+                unsigned short trot = enable_time_trot && r < MOD_TROT ? own & 1 << (r * 2 + 1) : 0;
+                unsigned short pass = after[turns(own & ~trot)];
+                unsigned short again = trot ? 1 << ((r < MOD_TROT - 1 ? r + 1 : 0) * 2) : 0;
 
-                    announcer_lock = false;
-                    announcer_cv.notify_all();
+                for (int j = 0; j < m.count; ++j) {
+                    reach[1][next[j]] |= pass;
+                    if (again) reach[0][trans.flip(next[j])] |= again;
                 }
             }
-        }
-    }
-}
-
-// Run a round-robin tournament on [thread] threads
-void round_robin(std::vector<std::pair<std::string, IStrategy *> > & strats,
-    std::vector<std::pair<int, std::string>> & victories,
-    void announcer(int games_played, int games_remaining, int high, std::string high_strat),
-    int announcer_interval, 
-    double margin, int threads,
-    double ** win_rate_mat,
-    volatile int * interrupt) {
-
-    // Compute permutations beforehand to prevent conflict between threads
-    if (!perms_computed) compute_perms();
-
-    size_t N = strats.size();
-    int high = 0, high_strat = 0;
+            else {
+                strat.set_roll_num(score, sum - score, 0);
+            }
 
-    victories.reserve(N);
-    for (size_t i = 0; i < N; ++i) victories.emplace_back(0, strats[i].first);
+            // the opponent moves: any roll number passes the turn
+            unsigned short oppo = reach[1][pair];
+            if (!oppo) continue;
 
-    int total_games = (int)N * ((int)N - 1) / 2, games_played = 0;
+            /* the j-th outcome of r >= 1 dice is the sum 2r + j - 1 (or 1 for j = 0), so only the outcomes
+               above the largest sum of r - 1 dice add new successors */
+            unsigned short pass = after[turns(oppo)];
+            for (int r = 0; r <= MAX_ROLLS; ++r) {
+                const TransitionTable::Moves & m = trans.moves(pair, r);
+                const unsigned short * next = trans.next() + m.offset;
 
-    std::vector<std::thread *> threadmgr;
-    threadmgr.reserve(threads);
+                for (int j = std::max(DICE_SIDES * (r - 1) - 2 * r + 2, 0); j < m.count; ++j) reach[0][next[j]] |= pass;
+            }
 
-    dp.resize(threads);
-    announcer_lock = false;
+            // or, rolling the turn number, trot
+            for (int turn = 0; enable_time_trot && turn < MOD_TROT; ++turn) {
+                if (!(oppo >> (turn * 2 + 1) & 1)) continue;
 
-    for (int i = 0; i < threads; ++i) {
-        std::thread * th = new std::thread(round_robin_coroutine,
-            &strats, announcer, announcer_interval,
-            margin, win_rate_mat, interrupt,
-            &high, &high_strat, &victories, &games_played, i, threads);
-        threadmgr.push_back(th);
-    }
+                const TransitionTable::Moves & m = trans.moves(pair, turn);
+                const unsigned short * next = trans.next() + m.offset;
+                unsigned short again = 1 << ((turn < MOD_TROT - 1 ? turn + 1 : 0) * 2);
 
-    for (int i = 0; i < threads; ++i) {
-        std::thread * th = threadmgr[i];
-        if (th -> joinable()) {
-            th -> join();
-            delete th;
+                for (int j = 0; j < m.count; ++j) reach[1][trans.flip(next[j])] |= again;
+            }
         }
     }
-
-    dp.resize(1);
-    std::sort(victories.begin(), victories.end(), wins_comparer);
 }
 
 // *** Graphing ***
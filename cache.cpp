@@ -0,0 +1,250 @@
+#include "stdafx.h"
+#include "cache.h"
+#include "hog.h"
+#include "lockfile.h"
+#include "mapping.h"
+
+// hide from linkage
+namespace {
+    // identifies a cache file (and its byte order)
+    const unsigned long long CACHE_MAGIC = 0x3143444d4e434142ULL; // "BACNMDC1"
+
+    // slots per bucket; a new key may go to any slot of its bucket
+    const size_t BUCKET_SLOTS = 4;
+
+    struct CacheHeader {
+        unsigned long long magic, capacity;
+    };
+
+    // 64-bit finalizer (splitmix64), used to mix fingerprints and checksums
+    inline unsigned long long mix(unsigned long long x) {
+        x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return x;
+    }
+
+    // Key of the current rules and game parameters kept in each slot
+    unsigned rules_key() {
+        return (unsigned)(rules_fingerprint() >> 32);
+    }
+}
+
+// *** Implementation of MatchupCache class ***
+
+MatchupCache::MatchupCache(const std::string & path, int capacity) : path(path), mapping(NULL), num_hits(0) {
+    static_assert(sizeof(Slot) == 32, "cache slots must be packed");
+
+    this->capacity = std::max((size_t)capacity / BUCKET_SLOTS, (size_t)1) * BUCKET_SLOTS;
+
+    LockedFile file(path);
+    if (!file.ok()) {
+        this->path.clear();
+        return;
+    }
+
+    size_t existing = file_capacity(file);
+
+    // missing, truncated or from another version: start over; too small: move the entries into a larger file
+    if (existing >= this->capacity) this->capacity = existing;
+    else if (!rebuild(file, existing)) {
+        this->path.clear();
+        return;
+    }
+
+    mapping = map_file(path, MAP_READ);
+    if (!mapping) this->path.clear();
+}
+
+MatchupCache::~MatchupCache() {
+    unmap_file(mapping);
+}
+
+size_t MatchupCache::file_capacity(LockedFile & file) {
+    CacheHeader header;
+    bool valid = file.read_at(0, &header, sizeof header) && header.magic == CACHE_MAGIC &&
+        header.capacity > 0 && header.capacity <= MAX_CAPACITY && header.capacity % BUCKET_SLOTS == 0 &&
+        file.size() >= sizeof header + header.capacity * sizeof(Slot);
+    return valid ? (size_t)header.capacity : 0;
+}
+
+bool MatchupCache::rebuild(LockedFile & file, size_t old_capacity) {
+    CacheHeader header = { CACHE_MAGIC, capacity };
+
+    // the entries to keep, read before their slots are cleared (the file is rewritten in place)
+    std::vector<Slot> old(old_capacity);
+    if (old_capacity && !file.read_at(sizeof header, &old[0], old.size() * sizeof(Slot))) return false;
+
+    // stale bytes of something else are dropped; a cache only grows, so other processes mapping it stay valid
+    if (!old_capacity && !file.resize(0)) return false;
+
+    FileMapping * m = map_file(path, MAP_UPDATE, sizeof header + capacity * sizeof(Slot));
+    if (!m) return false;
+
+    // the grown part of the file is already zero
+    Slot * slots = (Slot *)(m->data + sizeof header);
+    memset(slots, 0, old.size() * sizeof(Slot));
+
+    for (const Slot & slot : old) {
+        if (slot.check != checksum(slot)) continue;
+
+        size_t start = bucket(slot.a, slot.b, slot.rules);
+        for (size_t s = start; s < start + BUCKET_SLOTS; ++s) {
+            if (slots[s].check == 0) {
+                slots[s] = slot;
+                break;
+            }
+        }
+    }
+
+    memcpy(m->data, &header, sizeof header);
+
+    bool synced = sync_mapping(m);
+    unmap_file(m);
+    return synced;
+}
+
+int MatchupCache::capacity_for(size_t strategies) {
+    const char * forced = std::getenv("BACON_CACHE_MB");
+    if (forced) {
+        char * end;
+        long mb = std::strtol(forced, &end, 10);
+        long max_mb = (long)((unsigned long long)MAX_CAPACITY * sizeof(Slot) >> 20);
+
+        if (end != forced && *end == 0 && mb > 0 && mb <= max_mb) return (int)(((unsigned long long)mb << 20) / sizeof(Slot));
+
+        // reported on stderr, to keep it out of results
+        std::cerr << "Warning: BACON_CACHE_MB must be a number of megabytes from 1 to " << max_mb <<
+            " (got '" << forced << "'). Sizing the cache from the number of strategies." << std::endl;
+    }
+
+    // each game is cached once, whichever strategy plays first
+    unsigned long long games = (unsigned long long)strategies * (strategies - (strategies > 0)) / 2;
+    unsigned long long wanted = games + games / 3;
+
+    return (int)std::max((unsigned long long)DEFAULT_CAPACITY, std::min((unsigned long long)MAX_CAPACITY, wanted));
+}
+
+unsigned long long MatchupCache::fingerprint(MatrixStrategy & strat) {
+    unsigned long long key = 0;
+    for (int i = 0; i < GOAL; ++i) {
+        for (int j = 0; j < GOAL; ++j) {
+            key = mix(key ^ (unsigned long long)strat.get_roll_num(i, j));
+        }
+    }
+    return key;
+}
+
+size_t MatchupCache::bucket(unsigned long long a, unsigned long long b, unsigned rules) const {
+    return (size_t)(mix(a ^ mix(b ^ rules)) % (capacity / BUCKET_SLOTS)) * BUCKET_SLOTS;
+}
+
+unsigned MatchupCache::checksum(const Slot & slot) {
+    unsigned long long bits;
+    memcpy(&bits, &slot.win_rate, sizeof bits);
+    return (unsigned)(mix(slot.a ^ mix(slot.b ^ mix(slot.rules ^ mix(bits)))) >> 32) | 1;
+}
+
+bool MatchupCache::lookup(unsigned long long a, unsigned long long b, double & win_rate) const {
+    if (!mapping) return false;
+
+    const Slot * slots = (const Slot *)(mapping->data + sizeof(CacheHeader));
+    unsigned rules = rules_key();
+
+    // results may have been computed either way round
+    for (int flip = 0; flip < 2; ++flip) {
+        size_t start = bucket(a, b, rules);
+
+        for (size_t s = start; s < start + BUCKET_SLOTS; ++s) {
+            const Slot & slot = slots[s];
+            if (slot.a == a && slot.b == b && slot.rules == rules && slot.check == checksum(slot)) {
+                win_rate = flip ? 1.0 - slot.win_rate : slot.win_rate;
+                ++num_hits;
+                return true;
+            }
+        }
+
+        std::swap(a, b);
+    }
+    return false;
+}
+
+void MatchupCache::insert(unsigned long long a, unsigned long long b, double win_rate) {
+    Slot slot;
+    slot.a = a;
+    slot.b = b;
+    slot.rules = rules_key();
+    slot.win_rate = win_rate;
+    slot.check = checksum(slot);
+
+    std::vector<Slot> batch;
+    {
+        std::lock_guard<std::mutex> lck(pending_mtx);
+        auto now = std::chrono::steady_clock::now();
+
+        if (pending.empty()) pending_since = now;
+        pending.push_back(slot);
+
+        if (pending.size() >= (size_t)SAVE_RESULTS || now - pending_since >= std::chrono::seconds(SAVE_SECONDS)) batch.swap(pending);
+    }
+
+    if (!batch.empty()) write(batch);
+}
+
+int MatchupCache::save() {
+    std::vector<Slot> batch;
+    {
+        std::lock_guard<std::mutex> lck(pending_mtx);
+        batch.swap(pending);
+    }
+
+    return write(batch);
+}
+
+int MatchupCache::write(const std::vector<Slot> & batch) {
+    std::lock_guard<std::mutex> lck(write_mtx);
+    if (batch.empty() || path.empty()) return 0;
+
+    LockedFile file(path);
+    size_t current = file.ok() ? file_capacity(file) : 0;
+
+    /* another process may have enlarged the cache since it was mapped: map it again, and place the results
+       by its new capacity */
+    if (current && current != capacity) {
+        unmap_file(mapping);
+        mapping = map_file(path, MAP_READ);
+        capacity = current;
+    }
+
+    // or replaced it with something else; the results are dropped rather than kept for ever
+    if (!current || !mapping) {
+        std::cerr << "Warning: the matchup cache '" << path << "' can no longer be written; " <<
+            batch.size() << " results were not saved." << std::endl;
+        return 0;
+    }
+
+    int written = 0;
+
+    for (const Slot & slot : batch) {
+        // re-read the bucket: other processes may have written to it
+        size_t start = bucket(slot.a, slot.b, slot.rules);
+        Slot current[BUCKET_SLOTS];
+        unsigned long long offset = sizeof(CacheHeader) + start * sizeof(Slot);
+        if (!file.read_at(offset, current, sizeof current)) break;
+
+        // the same key, else a free (or torn) slot, else a slot chosen by the key
+        size_t target = BUCKET_SLOTS;
+        for (size_t s = 0; s < BUCKET_SLOTS && target == BUCKET_SLOTS; ++s) {
+            if (current[s].a == slot.a && current[s].b == slot.b && current[s].rules == slot.rules) target = s;
+        }
+        for (size_t s = 0; s < BUCKET_SLOTS && target == BUCKET_SLOTS; ++s) {
+            if (current[s].check != checksum(current[s])) target = s;
+        }
+        if (target == BUCKET_SLOTS) target = (size_t)(mix(slot.a + slot.b) % BUCKET_SLOTS);
+
+        if (!file.write_at(offset + target * sizeof(Slot), &slot, sizeof slot)) break;
+        ++written;
+    }
+
+    return written;
+}
@@ -30,20 +30,6 @@ int roll_dice(int num_rolls, IDice& dice) {
     return sum;
 }
 
-int free_bacon(int score) {
-    return std::max(2 * (score / 10 % 10) - score % 10, 1);
-    /*
-    // SP18 rules
-    int max_digit = 0;
-
-    while (score > 0) {
-        max_digit = std::max(score % 10, max_digit);
-        score /= 10;
-    }
-    return max_digit + 1;
-    */
-}
-
 int take_turn(int num_rolls, int score1, IDice& dice){
     int delta = 0;
 	
@@ -59,12 +45,7 @@ int take_turn(int num_rolls, int score1, IDice& dice){
 
 int is_swap(int score0, int score1) {
     if (!enable_swine_swap) return false;
-    return abs(score0 / 10 % 10 - score0 % 10) == abs(score1 / 10 % 10 - score1 % 10);
-    /*
-    // SP18 rules
-    if (score0 <= 1 || score1 <= 1) return false;
-    return score0 % score1 == 0 || score1 % score0 == 0;
-    */
+    return swap_condition(score0, score1);
 }
 
 int is_time_trot(int turn_num, int rolls) {
@@ -72,6 +53,24 @@ int is_time_trot(int turn_num, int rolls) {
     return turn_num % MOD_TROT == rolls;
 }
 
+unsigned long long rules_fingerprint() {
+    // splitmix64 finalizer
+    auto mix = [](unsigned long long x) {
+        x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return x;
+    };
+
+    unsigned long long key = mix(GOAL);
+    key = mix(key ^ DICE_SIDES);
+    key = mix(key ^ MAX_ROLLS);
+    key = mix(key ^ MOD_TROT);
+    key = mix(key ^ (enable_swine_swap ? 1 : 0));
+    key = mix(key ^ (enable_time_trot ? 1 : 0));
+    return key;
+}
+
 std::pair<int, int> play(IStrategy& strategy0, IStrategy& strategy1, int score0, int score1, 
                     IDice& dice, int goal, int starting_turn) {
 
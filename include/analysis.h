@@ -44,6 +44,10 @@
             std::pair<int, int>focus = std::pair<int, int>(GOAL-1, GOAL-1), volatile int * interrupt = NULL,
             bool quiet = false, int announce_interval = 10, int wr_interval = 100);
 
+        /* Replaces the strategy with the best response to the specified opponent (see create_best_response),
+           which training against that opponent can then refine */
+        void seed_best_response(IStrategy & oppo_strat);
+
         /* Takes a pair representing the current "focus" point of training and returns the next "focus" point
            in the sequence. Will automatically go over all focus points */
         static std::pair<int, int> next_focus(std::pair<int, int> focus);
@@ -63,29 +67,139 @@
         }
     };
 
-    // Compute the absolute theoretical win rate of a strategy against another
+    /* Compute the absolute theoretical win rate of a strategy against another.
+       If threads > 1, the computation is split across that many threads of the worker pool */
     double average_win_rate(IStrategy & strategy0, IStrategy & strategy1 = DEFAULT_STRATEGY,
                             int strategy0_plays_as = -1, int score0 = 0, int score1 = 0,
-                            int starting_turn = 0, int thread_id = 0);
+                            int starting_turn = 0, int thread_id = 0, int threads = 1);
+
+    // Number of opponents evaluated together by average_win_rates (one vector lane each)
+    const int WIN_RATE_BATCH = 8;
+
+    /* Compute the absolute theoretical win rates of a strategy against each of several opponents,
+       from the start of the game, in one traversal of the state space per WIN_RATE_BATCH opponents.
+       win_rates[i] receives the win rate against opponents[i]. */
+    void average_win_rates(IStrategy & strategy0, const std::vector<IStrategy *> & opponents, double * win_rates,
+                            int strategy0_plays_as = -1, int thread_id = 0, int threads = 1);
+
+    // DP table of the win rate computations (defined in analysis.cpp)
+    class WinRateStorage;
+
+    /* Keeps the full win rate DP table of a strategy against an opponent, so that after changing the
+       roll number of either strategy at one pair of scores the win rate is updated by recomputing only
+       the states depending on that cell: the states at the cell itself, then, by descending score sum,
+       those with a successor whose value changed. The sums over the outcomes of each move are taken in order,
+       so results are identical to average_win_rates (they may differ from average_win_rate in the last bit).
+
+       Both strategies are copied on construction. The rule set must not change during the lifetime
+       of the evaluator. */
+    class IncrementalWinRate {
+    public:
+        // Computes the full table for 'strategy0' against 'strategy1' (with one sweep of all states)
+        IncrementalWinRate(IStrategy & strategy0, IStrategy & strategy1);
+
+        ~IncrementalWinRate();
+
+        // The win rate of strategy0 from the start of the game, as given by average_win_rates
+        double win_rate(int strategy0_plays_as = -1, int starting_turn = 0);
+
+        // The strategy (who = 0) or the opponent (who = 1) as currently evaluated
+        MatrixStrategy & strategy(int who);
+
+        /* Sets the number of dice the strategy (who = 0) or the opponent (who = 1) rolls at (score, oppo_score),
+           from the point of view of that player, and updates the table.
+           Returns the number of states recomputed (zero if the roll number was unchanged). */
+        long long set_roll_num(int who, int score, int oppo_score, int rolls);
+
+        /* Makes the strategy (who = 0) or the opponent (who = 1) roll as 'strat' does at every pair of scores,
+           and updates the table in a single pass over the states depending on any of the changed cells,
+           so that moving to a near-identical strategy costs much less than a new sweep. Returns the number
+           of states recomputed (zero if no roll number changed). */
+        long long set_strategy(int who, IStrategy & strat);
+
+        // Total number of states recomputed so far, including the initial sweep
+        long long states_touched() const;
+
+        // Number of states computed by a full sweep (the cost of one average_win_rate call) under the current rules
+        static long long total_states();
+
+    private:
+        MatrixStrategy strats[2];
+        WinRateStorage * table;
+        long long touched;
+
+        /* Recomputes the edited states, whose score sums are between 'bottom' and 'top', and then all states
+           depending on them. Returns the number of states recomputed. */
+        long long update(int top, int bottom);
+
+        // whether the value of each state (indexed by pair of scores * 2 + who) changed during the current update
+        std::vector<char> changed;
+
+        // whether the roll number at each state (indexed as above) was edited since the last update
+        std::vector<char> edited;
+
+        // non-copyable
+        IncrementalWinRate(const IncrementalWinRate &);
+        IncrementalWinRate & operator=(const IncrementalWinRate &);
+    };
+
+    /* Allocates DP storage for thread ids 0 .. threads - 1 of the win rate computations, so that many
+       threads may compute win rates at once (each with its own thread_id). Call with 1 to release it.
+       Each thread id takes about 1.6 MB for average_win_rate and, from its first call of average_win_rates,
+       13 MB more for the batched table. Not thread safe. */
+    void resize_win_rate_storage(int threads);
+
+    /* Number of DP states computed so far by average_win_rate and average_win_rates with the tables of
+       thread_id (every lane of a batch counts), for progress metrics. Starts from 0 when the storage is resized. */
+    long long states_computed(int thread_id = 0);
 
     // Compute the win rate of a strategy against another using sampling
     double average_win_rate_by_sampling(IStrategy & strategy0, IStrategy & strategy1 = DEFAULT_STRATEGY,
                             int strategy0_plays_as = -1, int score0 = 0, int score1 = 0,
                             int starting_turn = 0, int samples = DEFAULT_WR_SAMPLES);
 
-    /* Run a round-robin tournament. Returns a vector of pairs where
-       the first element of each item is the number of wins,
-       and the second is the name of the player */
-    void round_robin(std::vector<std::pair<std::string, IStrategy *>> & strats,
-        std::vector<std::pair<int, std::string>> & victories,
-        void announcer(int games_played, int games_remaining, int high, std::string high_strat) = NULL,
-        int announcer_interval = 100,
-        double margin = 0.500001, int threads = 4,
-        double ** win_rate_mat = NULL,
-        volatile int * interrupt = NULL);
-
-    // Compute the "final" strategy using DP
-    MatrixStrategy * create_final_strat(bool quiet=false);
+    /* A policy that may depend on the whole state of the game: the number of dice to roll at each pair
+       of scores, turn number (mod MOD_TROT) and trot flag (1 if Time Trot may be used this turn) */
+    class TurnPolicy {
+    public:
+        // Create a policy that rolls 0 at every state
+        TurnPolicy() { memset(rolls, 0, sizeof rolls); }
+
+        // Get the number the policy rolls at a state
+        inline int operator() (int score, int oppo_score, int turn, int trot) const {
+            return rolls[turn][trot][score][oppo_score];
+        }
+
+        // Set the number the policy rolls at a state
+        inline void set_roll_num(int score, int oppo_score, int turn, int trot, int roll) {
+            rolls[turn][trot][score][oppo_score] = (unsigned char)roll;
+        }
+
+        /* Write the policy to a file: a "policy" header with MOD_TROT, then for each turn number and trot flag
+           a "turn t trot f" line followed by the roll numbers, laid out as in MatrixStrategy::write_to_file */
+        void write_to_file(std::string path);
+
+    private:
+        unsigned char rolls[MOD_TROT][2][GOAL][GOAL];
+    };
+
+    /* Compute the "final" strategy: exact optimal play using DP over the full game state.
+       If policy is not NULL, it receives the optimal roll number at every turn number and trot flag.
+       The DP table of thread_id is used (see resize_win_rate_storage) */
+    MatrixStrategy * create_final_strat(bool quiet=false, TurnPolicy * policy=NULL, int thread_id=0);
+
+    /* Compute the best response to a strategy using a single DP sweep: the MatrixStrategy that picks,
+       at each pair of scores, the roll number maximizing its win rate given the opponent's policy.
+       Exact when Time Trot is disabled; with Time Trot each roll number is chosen for all turn numbers
+       at once (a strategy cannot see the turn number). The first sweep weights the turn numbers equally;
+       each further sweep weights them by the probability of reaching them under the previous response,
+       for up to 8 sweeps in all or until the response stops changing. The DP table of thread_id is used. */
+    MatrixStrategy * create_best_response(IStrategy & oppo_strat, bool quiet=false, int thread_id=0);
+
+    /* Sets the roll number of 'strat' to 0 at every pair of scores where no game can ask it to move,
+       whatever the opponent does and whoever goes first. Such cells never affect a win rate, so strategies
+       that are equal after masking have the same win rate against every opponent. */
+    void mask_unreachable(MatrixStrategy & strat);
 
     // Draw the diagram for a specific strategy
     void draw_strategy_diagram(IStrategy & strat);
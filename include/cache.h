@@ -0,0 +1,112 @@
+#pragma once
+
+#include "stdafx.h"
+#include "strategy.h"
+
+#ifndef CACHE_H
+    #define CACHE_H
+
+    // a file mapped into memory (see mapping.h), and one locked against other processes (see lockfile.h)
+    struct FileMapping;
+    class LockedFile;
+
+    /* A persistent cache of exact matchup results, shared by all bacon processes that use the same file.
+       Entries are keyed by the fingerprints of both roll matrices and of the rule set (Swine Swap, Time Trot,
+       goal score and dice parameters), so a strategy keeps its results across renames and re-imports,
+       and results computed under other rules are never mixed in.
+
+       The file has a fixed number of slots, grouped into small buckets by key; when a bucket is full
+       a new result replaces one of the old ones, so the file only grows when a larger field asks for more slots.
+       Each access to the file holds an exclusive lock on it, and every slot carries a checksum,
+       so an entry torn by a crashed writer is simply treated as missing. The file is memory-mapped for lookups
+       rather than read into memory, so only the buckets a run looks at are ever read. */
+    class MatchupCache {
+    public:
+        // default (and smallest) number of slots (32 bytes each), enough for a full tournament of about 700 strategies
+        static const int DEFAULT_CAPACITY = 1 << 18;
+
+        // largest number of slots (512 MB), enough for a full tournament of about 5000 strategies
+        static const int MAX_CAPACITY = 1 << 24;
+
+        // recorded results are written to the file once this many are waiting, or the oldest is this many seconds old
+        static const int SAVE_RESULTS = 256;
+        static const int SAVE_SECONDS = 5;
+
+        /* Number of slots to give the cache for a tournament of 'strategies' strategies: room for all its games
+           with a quarter of the slots to spare, within DEFAULT_CAPACITY and MAX_CAPACITY. If the BACON_CACHE_MB
+           environment variable is set, the cache is given that many megabytes instead. */
+        static int capacity_for(size_t strategies);
+
+        /* Opens the cache at 'path', creating it with 'capacity' slots if it does not exist or is unreadable,
+           and maps it. An existing cache with fewer slots is enlarged, keeping its entries; one with more
+           keeps its capacity. If the file can not be opened, the cache stays empty and save() does nothing. */
+        explicit MatchupCache(const std::string & path, int capacity = DEFAULT_CAPACITY);
+
+        // Unmaps the file (results not saved are lost)
+        ~MatchupCache();
+
+        // Fingerprint of a strategy's roll matrix, used as its key in the cache
+        static unsigned long long fingerprint(MatrixStrategy & strat);
+
+        /* Looks up the average win rate of the strategy with fingerprint 'a' against the one with fingerprint 'b'
+           under the current rules. Returns false if it is not cached. Thread safe. */
+        bool lookup(unsigned long long a, unsigned long long b, double & win_rate) const;
+
+        /* Records the average win rate of 'a' against 'b' under the current rules. Results are written to the file
+           in batches (see SAVE_RESULTS), as save() does, so a long run loses few of them if it is killed.
+           Thread safe, but must not run concurrently with lookup(). */
+        void insert(unsigned long long a, unsigned long long b, double win_rate);
+
+        /* Writes the results not written yet to the file, where lookup() finds them from then on. If another
+           process has enlarged the file meanwhile, it is mapped again and the results are placed by its new capacity;
+           if the file is no longer a cache, they are dropped with a warning on stderr.
+           Returns the number of results written. Must not run concurrently with lookup(). */
+        int save();
+
+        // Number of successful lookups so far
+        int hits() const { return num_hits; }
+
+    private:
+        struct Slot {
+            unsigned long long a, b;
+            unsigned rules, check;
+            double win_rate;
+        };
+
+        // bucket of slots a key belongs to
+        size_t bucket(unsigned long long a, unsigned long long b, unsigned rules) const;
+
+        // checksum of a slot's contents (never 0, so that empty slots are invalid)
+        static unsigned checksum(const Slot & slot);
+
+        // Number of slots of the cache in the open, locked 'file' (0 if it is not a whole cache)
+        static size_t file_capacity(LockedFile & file);
+
+        // Writes 'batch' to the file (see save). Returns the number of results written.
+        int write(const std::vector<Slot> & batch);
+
+        /* Rewrites the open, locked 'file' as an empty cache of 'capacity' slots, moving in the valid entries
+           of its first 'old_capacity' slots (0 if it is not a cache). Returns false on error. */
+        bool rebuild(LockedFile & file, size_t old_capacity);
+
+        std::string path;
+        size_t capacity;
+
+        // the file, mapped for reading (NULL if it could not be opened)
+        FileMapping * mapping;
+
+        // results not written yet, and when the oldest of them was recorded
+        std::vector<Slot> pending;
+        std::chrono::steady_clock::time_point pending_since;
+
+        // 'write_mtx' is held while writing to the file, 'pending_mtx' only to record or take results
+        std::mutex pending_mtx, write_mtx;
+
+        mutable std::atomic<int> num_hits;
+
+        // non-copyable
+        MatchupCache(const MatchupCache &);
+        MatchupCache & operator=(const MatchupCache &);
+    };
+
+#endif
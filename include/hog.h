@@ -17,18 +17,45 @@
     int roll_dice(int num_rolls, IDice& dice = DEFAULT_DICE);
     
     // Returns the amount of points earned if the free bacon rule is applied at a score
-    int free_bacon(int score);
+    inline int free_bacon(int score) {
+        return std::max(2 * (score / 10 % 10) - score % 10, 1);
+        /*
+        // SP18 rules
+        int max_digit = 0;
+
+        while (score > 0) {
+            max_digit = std::max(score % 10, max_digit);
+            score /= 10;
+        }
+        return max_digit + 1;
+        */
+    }
     
     /* Adds the points obtained by rolling 'num_rolls' of 'dice' to the player's score and sees if any rules apply. 
        Returns the player's score after this turn*/
     int take_turn(int num_rolls, int score1, IDice& dice = DEFAULT_DICE);
 	
+    /* Returns true if 'score0', 'score1' meet the condition for Swine Swap,
+       regardless of whether Swine Swap is enabled. Inline so that DP kernels can use it directly */
+    inline int swap_condition(int score0, int score1) {
+        return abs(score0 / 10 % 10 - score0 % 10) == abs(score1 / 10 % 10 - score1 % 10);
+        /*
+        // SP18 rules
+        if (score0 <= 1 || score1 <= 1) return false;
+        return score0 % score1 == 0 || score1 % score0 == 0;
+        */
+    }
+
     // Returns true if reaching 'score0', 'score1' on a turn would result in a swap
     int is_swap(int score0, int score1);
     
     // Returns true if the time trot rule applies when a player rolls 'rolls' on turn 'turn_num'
     int is_time_trot(int turn_num, int rolls);
 
+    /* Fingerprint of the rules in effect and the game parameters (GOAL, DICE_SIDES, MAX_ROLLS, MOD_TROT),
+       for keying results that are only valid under them */
+    unsigned long long rules_fingerprint();
+
     /*Simulate a game between two strategies,
       starting at 'score0' and 'score1' at turn 'starting_turn' with goal score 'goal'.*/
     std::pair<int, int> play(IStrategy & strategy0, IStrategy & strategy1, int score0 = 0, int score1 = 0,
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "stdafx.h"
+
+#ifndef LOCKFILE_H
+    #define LOCKFILE_H
+
+    /* A file opened (created if missing) and exclusively locked against other processes for as long as this
+       object lives. Plain reads and writes at given offsets; ok() is false if the file could not be opened or locked.
+       Used by the files shared between runs, such as the matchup cache and the strategy store. */
+    class LockedFile {
+    public:
+        // Opens the file at 'path' and waits until it is locked
+        explicit LockedFile(const std::string & path);
+
+        // Unlocks and closes the file
+        ~LockedFile();
+
+        bool ok() const { return locked; }
+
+        // Current size of the file in bytes (0 on error)
+        unsigned long long size();
+
+        // Reads exactly 'size' bytes at 'offset'. Returns false on error or end of file.
+        bool read_at(unsigned long long offset, void * data, size_t size);
+
+        // Writes 'size' bytes at 'offset'. Returns false on error.
+        bool write_at(unsigned long long offset, const void * data, size_t size);
+
+        // Sets the size of the file (new bytes are zero)
+        bool resize(unsigned long long size);
+
+    private:
+    #ifdef _WIN32
+        void * handle;
+    #else
+        int fd;
+    #endif
+        bool locked;
+
+        // non-copyable
+        LockedFile(const LockedFile &);
+        LockedFile & operator=(const LockedFile &);
+    };
+
+#endif
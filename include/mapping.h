@@ -0,0 +1,43 @@
+#pragma once
+
+#include "stdafx.h"
+
+#ifndef MAPPING_H
+    #define MAPPING_H
+
+    // A file mapped into memory (for reading, or for reading and writing)
+    struct FileMapping {
+        char * data;
+        size_t size;
+        bool write;
+    #ifdef _WIN32
+        void * file, * map;
+    #else
+        int fd;
+    #endif
+    };
+
+    // how map_file opens a file
+    enum MapMode {
+        // the whole existing file, read-only
+        MAP_READ,
+        // a new file of the given size (replacing any existing one), for reading and writing
+        MAP_CREATE,
+        // the existing file (or a new one), for reading and writing, grown to at least the given size
+        MAP_UPDATE
+    };
+
+    // Maps the file at 'path' as 'mode' says ('size' is ignored for MAP_READ). Returns NULL on error.
+    FileMapping * map_file(const std::string & path, MapMode mode, size_t size = 0);
+
+    // Unmaps and closes the file (NULL is ignored)
+    void unmap_file(FileMapping * m);
+
+    /* Grows or shrinks a file mapped for writing to 'size' bytes and maps it again; m->data may move.
+       Returns false on error, in which case the mapping is left as it was if possible. */
+    bool resize_mapping(FileMapping * m, size_t size);
+
+    // Writes the changes to a mapped file to disk and waits until they are there. Returns false on error.
+    bool sync_mapping(FileMapping * m);
+
+#endif
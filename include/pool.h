@@ -0,0 +1,58 @@
+#pragma once
+
+#include "stdafx.h"
+
+#ifndef POOL_H
+    #define POOL_H
+
+    /* A persistent pool of worker threads. The threads are started once and then reused
+       for every job, so that a job may be split across cores without paying for thread creation.
+       The thread calling run() always takes part in the job as worker 0. */
+    class WorkerPool {
+    public:
+        // Creates a pool that runs each job on 'threads' threads (including the calling thread)
+        explicit WorkerPool(int threads);
+
+        // Stops and joins all worker threads
+        ~WorkerPool();
+
+        // Number of threads that take part in each job
+        int size() const { return num_threads; }
+
+        /* Runs job(worker, workers) on every thread in the pool and blocks until all of them return.
+           Only one job may run at a time; concurrent callers are serialized. */
+        void run(const std::function<void(int, int)> & job);
+
+        /* Barrier for use inside a job: blocks until every thread in the pool has called sync().
+           Everything written before the barrier is visible to all threads after it. */
+        void sync();
+
+    private:
+        // main loop of each worker thread (other than the calling thread)
+        void worker_loop(int index);
+
+        int num_threads;
+        std::vector<std::thread> workers;
+
+        // serializes calls to run()
+        std::mutex run_mtx;
+
+        // job handoff
+        std::mutex mtx;
+        std::condition_variable job_cv, done_cv;
+        const std::function<void(int, int)> * job = NULL;
+        unsigned long long job_id = 0;
+        int running = 0;
+        bool stopping = false;
+
+        // state of the barrier used by sync()
+        std::atomic<int> barrier_count;
+        std::atomic<unsigned> barrier_generation;
+    };
+
+    /* Returns the process-wide pool with the specified number of threads for 'slot', creating it on first use.
+       Callers that may run jobs at the same time use different slots, so that they do not wait for each other
+       (as the win rate requests of a server do, one slot per DP table). Pools are kept alive until the program exits. */
+    WorkerPool & worker_pool(int threads, int slot = 0);
+
+#endif
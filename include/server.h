@@ -0,0 +1,60 @@
+#pragma once
+
+#include "stdafx.h"
+
+#ifndef SERVER_H
+    #define SERVER_H
+
+    /* A server answering requests over a Unix domain socket. Every message, either way, is a 4-byte length
+       (big-endian) followed by that many bytes. Each client connection is served on a thread of its own, one
+       request at a time: the reply to a request is sent before the next request on the connection is read.
+       What requests and replies contain is up to the handler. Unix domain sockets are not supported on Windows. */
+    class SocketServer {
+    public:
+        /* Takes the bytes of a request and returns those of the reply. Called on the thread of the connection,
+           so it may be called on several threads at once. */
+        typedef std::function<std::string(const std::string &)> Handler;
+
+        // the longest message accepted, in bytes
+        static const unsigned MAX_MESSAGE = 1u << 26;
+
+        /* Listens at 'path', replacing the socket file of a server that is no longer running.
+           ok() is false on error (such as another server listening at 'path'); error() then tells why. */
+        SocketServer(const std::string & path, const Handler & handler);
+
+        // Closes every connection (waiting for the requests being answered) and removes the socket file
+        ~SocketServer();
+
+        bool ok() const { return listen_fd >= 0; }
+
+        const std::string & error() const { return error_msg; }
+
+        // Accepts and serves clients until '*stop' is set (checked a few times a second)
+        void run(volatile int * stop);
+
+    private:
+        // Answers the requests of the client on 'fd' until it disconnects
+        void serve_client(int fd);
+
+        // Joins the threads of clients that have disconnected and closes their sockets
+        void reap_clients();
+
+        std::string path, error_msg;
+        Handler handler;
+        int listen_fd;
+
+        // thread serving each connection, by socket; sockets of disconnected clients, to be reaped
+        std::mutex mtx;
+        std::map<int, std::thread> clients;
+        std::vector<int> finished;
+
+        // non-copyable
+        SocketServer(const SocketServer &);
+        SocketServer & operator=(const SocketServer &);
+    };
+
+    /* Sends a request to the server listening at 'path' and waits for its reply.
+       Returns false on error, with the reason in 'error' if it is not NULL. */
+    bool send_request(const std::string & path, const std::string & request, std::string & reply, std::string * error = NULL);
+
+#endif
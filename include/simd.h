@@ -0,0 +1,46 @@
+#pragma once
+
+#include "stdafx.h"
+#include "params.h"
+
+#ifndef SIMD_H
+    #define SIMD_H
+
+    /* A kernel computing the sum of weight[j] * values[index[j]] for j < count, i.e. the dot product of
+       a weight vector with values gathered from a table. This is the inner reduction of the win rate DP. */
+    typedef double (*GatherDotKernel)(const double * weight, const unsigned short * index,
+                                      const double * values, int count);
+
+    // Portable implementation of the gather-dot kernel, used when no vector instructions are available
+    double gather_dot_scalar(const double * weight, const unsigned short * index, const double * values, int count);
+
+    /* Returns the fastest gather-dot kernel this CPU supports (AVX-512, AVX2 or scalar), detected once.
+       Set the environment variable BACON_SIMD to 'scalar', 'avx2' or 'avx512' to override the choice,
+       e.g. to make machines with different CPUs produce bit-identical results. */
+    GatherDotKernel gather_dot_kernel();
+
+    // Name of the instruction set used by gather_dot_kernel()
+    const char * simd_name();
+
+    // Number of independent values (lanes) per group handled by gather-lanes kernels
+    const int GATHER_LANES = 8;
+
+    // Maximum number of groups of lanes handled by a gather-lanes kernel in one pass
+    const int GATHER_GROUPS = MOD_TROT;
+
+    /* A kernel computing out[g * GATHER_LANES + l] = sum of weight[j] * values[index[j] * stride + g * GATHER_LANES + l]
+       for j < count, for every lane l of each of the first 'groups' groups; i.e. many gather-dot products over a
+       table whose entries (of 'stride' values) start with 'groups' groups of GATHER_LANES values.
+       Each lane is summed in order with separate multiplies and adds, so every implementation
+       gives bit-identical results and the result of a lane never depends on the other lanes. */
+    typedef void (*GatherLanesKernel)(const double * weight, const unsigned short * index, const double * values,
+                                      int stride, int groups, int count, double * out);
+
+    // Portable implementation of the gather-lanes kernel
+    void gather_lanes_scalar(const double * weight, const unsigned short * index, const double * values,
+                             int stride, int groups, int count, double * out);
+
+    // Returns the fastest gather-lanes kernel this CPU supports (see gather_dot_kernel; same override)
+    GatherLanesKernel gather_lanes_kernel();
+
+#endif
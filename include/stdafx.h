@@ -19,6 +19,10 @@
 #include<set>
 #include<algorithm>
 #include<thread>
+#include<chrono>
+#include<atomic>
+#include<functional>
+#include<memory>
 #include<condition_variable>
 #include<mutex>
 #include<string>
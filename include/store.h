@@ -0,0 +1,130 @@
+#pragma once
+
+#include "stdafx.h"
+#include "strategy.h"
+
+#ifndef STORE_H
+    #define STORE_H
+
+    // a file mapped into memory (see mapping.h)
+    struct FileMapping;
+
+    /* The imported strategies, kept in a binary file that is memory-mapped rather than parsed, so opening a store
+       of thousands of strategies only reads its name index, and each strategy's roll matrix is read when it is
+       first loaded. Changes are written in place: storing or removing a strategy touches its own slot and index
+       entry, never the rest of the file.
+
+       The file is cut into slots of GOAL * GOAL bytes (rounded up to 64). The first slots hold a 64-byte header
+       (magic, version, GOAL, slot size, capacity of the index, number of slots, generation) followed by the name index:
+       'capacity' entries of 128 bytes, each a name (up to MAX_NAME bytes, '\0'-terminated), the slot holding
+       that strategy's roll numbers (one byte per pair of scores, as MatrixStrategy::cells) and a flag marking
+       the entry in use, either by an imported strategy or by a derived one. Derived strategies are results kept
+       so they need not be computed again (such as _final under some rules); they have names of their own, apart
+       from the imported ones, and are never listed. A strategy being replaced is written to a free slot before its entry is switched over.
+       When the index is full it doubles, taking over the next slots and moving the strategies in them to the end.
+
+       Several processes may use the same store: each operation locks the file (see LockedFile) and, if another
+       process changed it since (the header's generation counter tells), reads the index again first. The file
+       never shrinks, so other processes' mappings stay valid. size(), contains() and names() tell what the index
+       held at the last operation.
+
+       Changes reach the file as they are made; commit() waits until they are on disk. Not thread safe. */
+    class StrategyStore {
+    public:
+        // the longest name that can be stored, in bytes
+        static const size_t MAX_NAME = 119;
+
+        /* Opens the store at 'path', creating it if it does not exist. ok() is false if it can not be opened
+           or is not a store for the current GOAL (it is then left untouched). */
+        explicit StrategyStore(const std::string & path);
+
+        // Syncs and closes the file
+        ~StrategyStore();
+
+        bool ok() const { return mapping != NULL; }
+
+        // Number of strategies stored
+        size_t size() const { return index.size(); }
+
+        // Returns true if a strategy with the name is stored
+        bool contains(const std::string & name) const { return index.count(name) > 0; }
+
+        // Names of the strategies stored, in alphabetical order
+        std::vector<std::string> names() const;
+
+        // Reads the strategy with the name into a new MatrixStrategy, or returns NULL if there is none
+        MatrixStrategy * load(const std::string & name);
+
+        /* Stores the roll numbers of 'strat' under the name, replacing any strategy with the same name.
+           Returns false if the name is too long or the file can not grow. */
+        bool put(const std::string & name, MatrixStrategy & strat);
+
+        // Removes the strategy with the name. Returns false if there is none (or the file can not be locked).
+        bool remove(const std::string & name);
+
+        // Removes every strategy, derived ones included. The file keeps its size; the slots are reused.
+        void clear();
+
+        // Reads the derived strategy stored under the key into a new MatrixStrategy, or returns NULL if there is none
+        MatrixStrategy * load_derived(const std::string & key);
+
+        /* Stores the roll numbers of 'strat' as a derived strategy under the key, replacing any with the same key.
+           Returns false if the key is too long or the file can not grow. */
+        bool put_derived(const std::string & key, MatrixStrategy & strat);
+
+        // Waits until the changes made so far are on disk. Returns false on error.
+        bool commit();
+
+    private:
+        struct Header;
+        struct Entry;
+
+        Header & header() const;
+        Entry & entry(size_t e) const;
+        unsigned char * slot(size_t s) const;
+
+        // Number of slots taken by the header and an index of 'capacity' entries
+        size_t index_slots(size_t capacity) const;
+
+        /* Reads the index from the file, dropping entries naming a slot out of range or already taken,
+           and lists the free entries and slots */
+        void read_index();
+
+        /* Catches up with changes made by other processes (call with the file locked): maps the slots they added
+           and reads the index again. Returns false if the file can no longer be mapped. */
+        bool refresh();
+
+        // Marks a change made by this process (with the file locked), so that other processes read the index again
+        void changed();
+
+        // Takes a free slot, growing the file if there is none. Returns 0 on error.
+        unsigned take_slot();
+
+        // Doubles the capacity of the index. Returns false on error.
+        bool grow_index();
+
+        // Reads the strategy named in 'names' (the index or the derived strategies), or returns NULL
+        MatrixStrategy * load(const std::map<std::string, unsigned> & names, const std::string & name);
+
+        // Stores a strategy in 'names', marking a new entry with 'kind'
+        bool put(std::map<std::string, unsigned> & names, unsigned kind, const std::string & name, MatrixStrategy & strat);
+
+        std::string path;
+        FileMapping * mapping;
+        size_t slot_size;
+
+        // generation of the file when this process last read or changed its index
+        unsigned generation;
+
+        // entry number of each stored name, and of each derived strategy's key
+        std::map<std::string, unsigned> index, derived;
+
+        // entries and slots not in use
+        std::vector<unsigned> free_entries, free_slots;
+
+        // non-copyable
+        StrategyStore(const StrategyStore &);
+        StrategyStore & operator=(const StrategyStore &);
+    };
+
+#endif
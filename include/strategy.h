@@ -64,31 +64,46 @@
         // Create an empty MatrixStrategy that rolls 0 for all scores
         explicit MatrixStrategy(const std::string & name = "") : name(name) { memset(rolls, 0, sizeof rolls); }
 
-        // Create a new MatrixStrategy by evaluating another strategy at each roll number
+        /* Create a new MatrixStrategy by evaluating another strategy at each roll number.
+           Roll numbers out of 0 .. MAX_ROLLS are clamped, with a warning on stderr. */
         MatrixStrategy(IStrategy & strat, const std::string & name);
 
-        // Create a new MatrixStrategy from an array
+        // Create a new MatrixStrategy from an array (roll numbers out of range are clamped, with a warning)
         MatrixStrategy(int ** mat, const std::string & name);
 
-        // Set the number the strategy rolls at a set of scores
-        void set_roll_num(int score0, int score1, int roll); 
+        // Create a new MatrixStrategy from GOAL * GOAL roll numbers, row by row (as returned by cells())
+        MatrixStrategy(const unsigned char * cells, const std::string & name) : name(name) { memcpy(rolls, cells, sizeof rolls); }
+
+        /* Set the number the strategy rolls at a set of scores. A roll number out of 0 .. MAX_ROLLS is clamped
+           into that range, with a warning on stderr, and false is returned. */
+        bool set_roll_num(int score0, int score1, int roll); 
 
         // Get the number the strategy rolls at a set of scores
         int get_roll_num(int score0, int score1); 
 
-        // Load the strategy matrix from a file
-        bool load_from_file(std::string path);
+        /* Load the strategy matrix from a file: a "strategy" header with the name, then GOAL * GOAL roll numbers
+           (0 to MAX_ROLLS), row by row, and nothing else but whitespace. Returns false, leaving the strategy
+           unchanged and describing the problem in 'error' (if given), if the file can not be read or is not
+           in this format. */
+        bool load_from_file(std::string path, std::string * error = NULL);
 
         // Write the strategy matrix to a file
         void write_to_file(std::string path, bool pyformat = false);
 
-        int operator() (int score0, int score1) {
+        /* Final so that calls through a MatrixStrategy (e.g. in the win rate DP kernel)
+           are devirtualized and read the matrix directly */
+        int operator() (int score0, int score1) final {
             return rolls[score0][score1];
         }
 
+        // The roll numbers, one byte per pair of scores, row by row (GOAL * GOAL bytes)
+        const unsigned char * cells() const { return &rolls[0][0]; }
+
         std::string name;
     private:
-        int rolls[GOAL][GOAL];
+        /* one byte per cell (roll numbers never exceed MAX_ROLLS), so a matrix takes GOAL * GOAL bytes
+           and the two matrices of a game fit in the L1 cache together during a DP sweep */
+        unsigned char rolls[GOAL][GOAL];
     };
 
     /* The swap_strategy from the Hog assignment. Swaps where beneficial, 
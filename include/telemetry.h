@@ -0,0 +1,91 @@
+#pragma once
+
+#include "stdafx.h"
+
+#ifndef TELEMETRY_H
+    #define TELEMETRY_H
+
+    /* Live metrics of a long tournament run, for dashboards: a background thread appends one JSON object per line
+       to a metrics file every few seconds (and once more when the run ends), so the file can be scraped while
+       the run goes on. Each line has the time, the current phase of the run and its progress, the progress of
+       the whole run, the matchups evaluated per second and DP states computed per second (over the last interval
+       and since the phase began), the same per thread, the memory in use and the estimated time left in the phase
+       and in the whole run, e.g.
+
+       {"time":1700000000.0,"elapsed":12.0,"phase":"exact","pairs_done":480,"pairs_total":1711,
+        "run_pairs_done":480,"run_pairs_total":1711,"pairs_per_sec":40.1,"states_per_sec":8020000,
+        "avg_pairs_per_sec":40.0,"memory_bytes":52428800,"eta_sec":30.8,"run_eta_sec":30.8,
+        "threads":[{"id":0,"pairs":480,"pairs_per_sec":40.1,"states_per_sec":8020000}]}
+
+       Workers report with record(), which only touches counters of their own. */
+    class TournamentTelemetry {
+    public:
+        // default number of seconds between lines
+        static const int DEFAULT_INTERVAL = 5;
+
+        /* Starts appending metrics for a run on 'threads' threads to the file at 'path', every 'interval' seconds.
+           ok() is false if the file can not be opened. */
+        TournamentTelemetry(const std::string & path, int threads, double interval = DEFAULT_INTERVAL);
+
+        // Writes a last line and stops the writer
+        ~TournamentTelemetry();
+
+        bool ok() const { return file != NULL; }
+
+        /* Starts a phase of the run (such as one round of a Swiss tournament) named 'name', in which 'pairs'
+           matchups are to be evaluated, and after which up to 'later_pairs' more are expected in later phases.
+           The rates and the time left in the phase are measured from here; the time left in the run is
+           estimated at the average rate since the run started. */
+        void begin_phase(const std::string & name, long long pairs, long long later_pairs = 0);
+
+        /* Records that thread 'thread_id' evaluated 'pairs' matchups, computing 'states' DP states (as counted
+           by the computation itself, e.g. states_computed). Thread safe. */
+        void record(int thread_id, int pairs, long long states) {
+            Counters & c = counters[thread_id];
+            c.pairs.fetch_add(pairs, std::memory_order_relaxed);
+            c.states.fetch_add(states, std::memory_order_relaxed);
+        }
+
+        // Appends a line now
+        void write();
+
+        // Memory used by this process (resident set size) in bytes, or 0 if unknown
+        static size_t memory_in_use();
+
+    private:
+        // counts of one thread since the start of the phase, each on its own cache line
+        struct Counters {
+            std::atomic<long long> pairs, states;
+            char padding[64 - 2 * sizeof(std::atomic<long long>)];
+        };
+
+        // Appends a line; 'mtx' must be held
+        void write_line();
+
+        // main loop of the writer thread
+        void writer_loop();
+
+        FILE * file;
+        int threads;
+        double interval;
+
+        std::unique_ptr<Counters[]> counters;
+
+        /* the current phase, and the matchups evaluated in earlier phases and expected in later ones;
+           'mtx' guards them and the counts at the last line, and serializes writes */
+        std::string phase;
+        long long phase_pairs, earlier_pairs, later_pairs;
+        std::chrono::steady_clock::time_point start, phase_start, last_time;
+        std::vector<long long> last_pairs, last_states;
+        std::mutex mtx;
+
+        std::thread writer;
+        std::condition_variable stop_cv;
+        bool stopping;
+
+        // non-copyable
+        TournamentTelemetry(const TournamentTelemetry &);
+        TournamentTelemetry & operator=(const TournamentTelemetry &);
+    };
+
+#endif
@@ -0,0 +1,223 @@
+#pragma once
+
+#include "stdafx.h"
+#include "strategy.h"
+#include "cache.h"
+#include "winrates.h"
+#include "telemetry.h"
+
+#ifndef TOURNAMENT_H
+    #define TOURNAMENT_H
+
+    // Summary of the work done by a round-robin tournament
+    struct TournamentStats {
+        // number of classes of equivalent strategies, each evaluated as one
+        int distinct_strategies;
+
+        // number of games played (in this shard)
+        int games;
+
+        /* number of games between distinct strategies that were evaluated, that were found in the cache,
+           and that were found in the journal of an earlier, interrupted run */
+        int games_evaluated, games_cached, games_resumed;
+
+        /* number of games evaluated by updating the DP table of a near-identical earlier game (with similarity
+           ordering), and the number of state evaluations that saved over full sweeps */
+        int games_reused;
+        long long states_saved;
+    };
+
+    /* A checkpoint journal for a tournament: a text file with a header identifying the tournament, followed by
+       one line per completed game between distinct strategies. Lines are written and synced to disk in batches,
+       so that a crash loses at most the last few seconds of work; a torn last line is ignored when reading. */
+    class TournamentJournal {
+    public:
+        // a batch of lines is synced to disk once it has this many lines, or is this many seconds old
+        static const int SYNC_LINES = 256;
+        static const int SYNC_SECONDS = 5;
+
+        /* Opens the journal at 'path' for the tournament with identifier 'id' (see tournament_id). If 'resume',
+           loads the results of an earlier run of the same tournament; otherwise, or if the journal belongs
+           to a different tournament, starts an empty journal. ok() is false if the file can not be written. */
+        TournamentJournal(const std::string & path, unsigned long long id, bool resume);
+
+        // Syncs any pending lines and closes the journal
+        ~TournamentJournal();
+
+        // Identifier of a tournament: depends on the names and roll matrices of the strategies, the rules and the shard
+        static unsigned long long tournament_id(std::vector<std::pair<std::string, IStrategy *>> & strats,
+            int shard = 0, int shards = 1);
+
+        bool ok() const { return file != NULL; }
+
+        // Number of results loaded from an earlier run
+        size_t size() const { return results.size(); }
+
+        // Looks up the result of strategy i against strategy j from an earlier run. Thread safe.
+        bool lookup(int i, int j, double & win_rate) const;
+
+        // Records the result of strategy i against strategy j. Thread safe.
+        void append(int i, int j, double win_rate);
+
+        // Writes and syncs all pending lines to disk
+        void sync();
+
+        // Closes and deletes the journal (once the results of the tournament have been saved)
+        void remove();
+
+    private:
+        // writes 'lines' to the file and syncs it; 'write_mtx' must be held
+        void write_lines(const std::string & lines);
+
+        std::string path;
+        FILE * file;
+
+        // results from an earlier run, by i * 2^32 + j
+        std::map<unsigned long long, double> results;
+
+        // lines not yet written, and when the oldest of them was added
+        std::string pending;
+        int pending_lines;
+        std::chrono::steady_clock::time_point pending_since;
+
+        std::mutex pending_mtx, write_mtx;
+
+        // non-copyable
+        TournamentJournal(const TournamentJournal &);
+        TournamentJournal & operator=(const TournamentJournal &);
+    };
+
+    // How round_robin runs a tournament; every option has a default, so only those wanted need be set
+    struct RoundRobinOptions {
+        // called with the progress every 'announcer_interval' games played (none if NULL)
+        void (*announcer)(int games_played, int games_remaining, int high, std::string high_strat);
+        int announcer_interval;
+
+        // a strategy wins a game with a win rate above this, loses below 1 - margin, and ties in between
+        double margin;
+
+        int threads;
+
+        // if given, receives the win rate of every game played
+        WinRateMatrix * win_rates;
+
+        // if given, the tournament stops early once it is set
+        volatile int * interrupt;
+
+        MatchupCache * cache;
+
+        // the slice of the games to play, 0 .. shards - 1 of 'shards'
+        int shard, shards;
+
+        TournamentJournal * journal;
+        TournamentTelemetry * telemetry;
+        bool similarity;
+
+        RoundRobinOptions() : announcer(NULL), announcer_interval(100), margin(0.500001), threads(4), win_rates(NULL),
+            interrupt(NULL), cache(NULL), shard(0), shards(1), journal(NULL), telemetry(NULL), similarity(false) {}
+    };
+
+    /* Run a round-robin tournament. Returns a vector of pairs where
+       the first element of each item is the number of wins,
+       and the second is the name of the player.
+
+       The matchups are split into work units (one group of strategies against a batch of up to WIN_RATE_BATCH
+       later groups, evaluated in one sweep), dealt out evenly to the threads. A thread that runs
+       out of units steals half of the remaining units of the busiest thread, so no thread idles
+       while there is work left. Each thread counts wins on its own scoreboard; these are merged
+       when all threads are done.
+
+       First, MatrixStrategies that are equal after masking the cells no game can reach (see mask_unreachable)
+       are grouped, so that each game between two groups is evaluated once for all of their members.
+       Members of the same group tie against each other. Returns the number of evaluations done and saved.
+
+       Of the options (see RoundRobinOptions): if 'shards' is more than 1, the games are dealt out to that many
+       shards in a fixed order and only those of shard 'shard' (0 .. shards - 1) are played (see write_shard_results).
+
+       If a journal is given, games it holds from an earlier run are not played again, and the result of every
+       game played is added to it.
+
+       If a cache is given, games between two groups of MatrixStrategies whose results are in the cache are not
+       played again, and the results of those that are played are saved to the cache in batches as they finish.
+
+       If telemetry is given, the threads report every matchup they evaluate to it, in an "exact" phase.
+
+       If 'similarity' is set, groups whose masked roll matrices differ in at most a few cells are found by
+       sorting the matrices, and each group's games against a run of such near-identical opponents are played
+       as a chain: one full sweep for the first, then an update of the same DP table (see IncrementalWinRate)
+       for each of the others. Results are identical to those of the batched evaluation. */
+    TournamentStats round_robin(std::vector<std::pair<std::string, IStrategy *>> & strats,
+        std::vector<std::pair<int, std::string>> & victories,
+        const RoundRobinOptions & options = RoundRobinOptions());
+
+    /* Counts the wins of each strategy from a complete matrix of win rates, as round_robin does,
+       into 'victories', sorted by wins in descending order, then by name */
+    void count_victories(const std::vector<std::string> & names, const WinRateMatrix & win_rates,
+        std::vector<std::pair<int, std::string>> & victories, double margin = 0.500001);
+
+    // ** Swiss-system tournaments **
+
+    // A contestant's line in the rating table of a Swiss-system tournament
+    struct SwissStanding {
+        std::string name;
+
+        // Elo rating, updated after every round from the results of the games played
+        double rating;
+
+        // 1 for each game won and 1/2 for each tie (by the margin, as in round_robin)
+        double points;
+
+        // number of games played
+        int games;
+    };
+
+    // rating every contestant starts with, and the most a single game can change it by
+    const double SWISS_INITIAL_RATING = 1500.0;
+    const double SWISS_K_FACTOR = 32.0;
+
+    /* Run a Swiss-system tournament of 'rounds' rounds, playing about N / 2 games per round
+       instead of the N (N - 1) / 2 of a round robin.
+
+       Each round, the contestants are taken in order of rating, and each one not yet paired plays the next one
+       it has not played yet; with an odd number, the lowest-rated contestant with the fewest byes sits out
+       and scores a full point, as for a win, but its rating does not change.
+       The games of a round are evaluated in parallel on 'threads' threads, and each is scored as the round robin
+       counts it: 1 for the winner by the margin, 0 for the loser, 1/2 each for a tie. (Scoring by the win rates
+       themselves ranks poorly: they are all close to 1/2.) Then every rating moves by SWISS_K_FACTOR times
+       the difference between the score of each of its games and the expected score for the ratings
+       at the start of the round, so the results do not depend on the order of the games.
+
+       Equivalent strategies tie without being evaluated (see round_robin), and the cache is used as in round_robin.
+       'standings' receives the rating table, sorted by points, then rating, then name. If 'interrupt' is set,
+       the current round is abandoned and the standings after the previous round are returned.
+       If telemetry is given, each round is a phase of its own. */
+    TournamentStats swiss(std::vector<std::pair<std::string, IStrategy *>> & strats,
+        std::vector<SwissStanding> & standings, int rounds,
+        void announcer(int games_played, int games_remaining, int high, std::string high_strat) = NULL,
+        double margin = 0.500001, int threads = 4,
+        volatile int * interrupt = NULL,
+        MatchupCache * cache = NULL,
+        TournamentTelemetry * telemetry = NULL);
+
+    /* Number of the first k strategies of 'ranking' (names, best first) that are also in the top k
+       of a round robin's 'victories' (as returned by round_robin; strategies tied with the k-th are included) */
+    int top_k_agreement(const std::vector<std::string> & ranking,
+        const std::vector<std::pair<int, std::string>> & victories, int k);
+
+    // ** Sharded tournaments **
+
+    /* Writes the results of shard 'shard' (0 .. shards - 1) of a tournament to a partial results file:
+       the games it played according to 'win_rates' (round_robin leaves the games of other shards unplayed),
+       along with the list of strategies.
+       Returns false if the file could not be written. */
+    bool write_shard_results(const std::string & path, int shard, int shards,
+        std::vector<std::pair<std::string, IStrategy *>> & strats, const WinRateMatrix & win_rates);
+
+    /* Combines the partial results files of every shard of a tournament into the names of the strategies and
+       the full matrix of win rates (in memory). Returns false,
+       with the reason in 'error', if the files are unreadable, from different tournaments, or do not
+       contain every game exactly once. */
+    bool read_shard_results(const std::vector<std::string> & paths, std::vector<std::string> & names,
+        WinRateMatrix & win_rates, std::string & error);
+
+#endif
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "stdafx.h"
+#include "params.h"
+
+#ifndef TRANSITION_H
+    #define TRANSITION_H
+
+    // ** Dice permutations **
+
+    // trp[i]: total permutations of rolling i dice: 1, 6, 36, ...
+    extern int total_roll_perms[MAX_ROLLS + 1];
+
+    // trps[i][j]: # ways to get sum j by rolling i dice
+    extern int total_roll_perms_for_sum[MAX_ROLLS + 1][DICE_SIDES * MAX_ROLLS + 1];
+
+    // prs[i][j]: probability of getting sum j by rolling i dice; = trps[i][j] / trp[i]
+    extern double prob_roll_sum[MAX_ROLLS + 1][DICE_SIDES * MAX_ROLLS + 1];
+
+    // pars[i]: probability of getting sum i by rolling any number (1-10) of dice; = sum(prs[0][i] ... prs[10][i]) / 10.0
+    extern double prob_any_roll_sum[DICE_SIDES * MAX_ROLLS + 1];
+
+    /* Computes the number of ways to get each number by rolling each number of dice (the tables above).
+       Does nothing if they have already been computed. Complexity n^2 * m */
+    void compute_perms();
+
+    // ** Transitions **
+
+    /* The outcomes of every move in the game of Hog, precomputed for one rule set.
+       These only depend on the rules (not on the strategies), so a single table is shared
+       by all win rate, final strategy and learning computations.
+
+       An outcome of rolling r dice at (score, oppo_score) is terminal iff score + k >= GOAL
+       (the player wins, or loses if the new scores swap); swapping never lifts a score below
+       the goal over it. So the non-terminal outcomes are always a prefix of the sequence
+       of sums k = 1, 2r, 2r + 1, ..., 6r (or just the free bacon score for r = 0), and the weight
+       of the j-th outcome only depends on r and j. The table thus stores one weight vector per
+       number of dice and, for each pair of scores and number of dice, the successor of every
+       non-terminal outcome, with terminal outcomes already folded into a single win weight. */
+    class TransitionTable {
+    public:
+        // number of distinct pairs of scores below the goal
+        static const int PAIRS = GOAL * GOAL;
+
+        // maximum number of outcomes of a single move: k = 1, 2r, ..., 6r for r = MAX_ROLLS
+        static const int MAX_OUTCOMES = (DICE_SIDES - 2) * MAX_ROLLS + 2;
+
+        // Summary of the outcomes of rolling a number of dice at a pair of scores
+        struct Moves {
+            // position of the first non-terminal outcome in next()
+            int offset;
+
+            // number of non-terminal outcomes
+            int count;
+
+            // total weight of outcomes where the player immediately wins
+            double win_weight;
+
+            // total weight of the non-terminal outcomes
+            double cont_weight;
+        };
+
+        // Builds the table for the rules given (Swine Swap on or off; Time Trot does not change outcomes)
+        explicit TransitionTable(bool swap);
+
+        ~TransitionTable();
+
+        // Index of the pair of scores (score, oppo_score)
+        static inline int index(int score, int oppo_score) {
+            return score * GOAL + oppo_score;
+        }
+
+        // Index of the same pair of scores seen from the other player, i.e. index(oppo_score, score)
+        inline int flip(int pair) const {
+            return flipped[pair];
+        }
+
+        // Outcomes of rolling 'r' dice at the pair of scores with index 'pair'
+        inline const Moves & moves(int pair, int r) const {
+            return move_info[pair * (MAX_ROLLS + 1) + r];
+        }
+
+        /* Successor of each non-terminal outcome, as the index of (new_oppo_score, new_score),
+           i.e. of the pair of scores seen by the opponent after the move. Use Moves::offset. */
+        inline const unsigned short * next() const {
+            return next_pair;
+        }
+
+        // Weight of the j-th outcome of rolling 'r' dice (the same for all pairs of scores)
+        inline const double * weights(int r) const {
+            return weight + r * MAX_OUTCOMES;
+        }
+
+        // 1 / the total weight of all outcomes of rolling 'r' dice
+        inline double inv_total(int r) const {
+            return inv_total_weight[r];
+        }
+
+    private:
+        Moves * move_info;
+        unsigned short * next_pair;
+        unsigned short * flipped;
+        double * weight;
+        double inv_total_weight[MAX_ROLLS + 1];
+
+        // raw allocation behind the (cache line aligned) arrays above
+        char * storage;
+
+        // non-copyable
+        TransitionTable(const TransitionTable &);
+        TransitionTable & operator=(const TransitionTable &);
+    };
+
+    /* Returns the transition table for the current rule set, building it on first use.
+       Tables are built once per rule set and kept until the program exits. Thread safe. */
+    const TransitionTable & transitions();
+
+#endif
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "stdafx.h"
+
+#ifndef WINRATES_H
+    #define WINRATES_H
+
+    // a file mapped into memory (see mapping.h)
+    struct FileMapping;
+
+    /* The win rates of every pair of strategies in a tournament, stored contiguously as a packed upper triangle:
+       the win rate of strategy i against strategy j > i is entry i * (2N - i - 1) / 2 + (j - i - 1). That of j
+       against i is 1 minus it, and every strategy ties against itself. Entries are doubles; games not played
+       yet are NaN.
+
+       The entries may also be written to a binary win rate file, memory-mapped so that each result reaches the
+       file as soon as it is set. The file is: a 64-byte header (magic, version, entry size, number of strategies,
+       offset of the names, offset of the entries), the names of the strategies (each ending with '\0'),
+       then the entries, starting at a multiple of 64 bytes, in native byte order. Read it with WinRateFile.
+       The file may hold floats to halve its size; the matrix itself keeps doubles, so that what is read from it
+       (winners, shard files, reports) is exact either way. */
+    class WinRateMatrix {
+    public:
+        // Creates an in-memory matrix for N strategies, with no games played
+        explicit WinRateMatrix(size_t N = 0);
+
+        /* Creates a matrix written to a new binary win rate file at 'path' (replacing any existing file)
+           for the strategies named 'names', with no games played. If 'single' is true the file stores floats,
+           and the exact doubles are also kept in memory. ok() is false if the file can not be created. */
+        WinRateMatrix(const std::string & path, const std::vector<std::string> & names, bool single = false);
+
+        // Syncs and closes the file, if any
+        ~WinRateMatrix();
+
+        // Replaces the contents with an in-memory matrix for N strategies, with no games played
+        void reset(size_t N);
+
+        bool ok() const { return entries != NULL; }
+
+        // Number of strategies
+        size_t size() const { return N; }
+
+        // Win rate of strategy i against strategy j (0.5 if i = j, NaN if their game has not been played)
+        inline double get(size_t i, size_t j) const {
+            if (i == j) return 0.5;
+            if (i < j) return entry(index(i, j));
+            return 1.0 - entry(index(j, i));
+        }
+
+        // Returns true if the game between strategies i and j has been played
+        inline bool has(size_t i, size_t j) const {
+            return i == j || !std::isnan(get(i, j));
+        }
+
+        /* Sets the win rate of strategy i against strategy j != i. Thread safe for different pairs of strategies.
+           (Stored as given when i < j, so that get(i, j) returns the exact value.) */
+        inline void set(size_t i, size_t j, double win_rate) {
+            if (i < j) set_entry(index(i, j), win_rate);
+            else set_entry(index(j, i), 1.0 - win_rate);
+        }
+
+        // Writes the entries to the file, if any, and waits until they are on disk. Returns false on error.
+        bool flush();
+
+        // Position of the game between strategies i < j among the entries
+        inline size_t index(size_t i, size_t j) const {
+            return i * (2 * N - i - 1) / 2 + (j - i - 1);
+        }
+
+    private:
+        inline double entry(size_t k) const {
+            return entries[k];
+        }
+
+        inline void set_entry(size_t k, double win_rate) {
+            entries[k] = win_rate;
+            if (file_floats) file_floats[k] = (float)win_rate;
+        }
+
+        // unmaps the file, if any, and frees the entries
+        void release();
+
+        size_t N;
+
+        // the entries, in 'memory' or in the mapped file
+        double * entries;
+        std::vector<double> memory;
+
+        // the entries of a win rate file of floats (NULL otherwise)
+        float * file_floats;
+
+        // the win rate file (NULL if in memory)
+        FileMapping * mapping;
+
+        // non-copyable
+        WinRateMatrix(const WinRateMatrix &);
+        WinRateMatrix & operator=(const WinRateMatrix &);
+    };
+
+    /* Reads a binary win rate file written by WinRateMatrix. The file is memory-mapped, so only the parts
+       that are used are read from disk; it may be read while the tournament writing it is still running. */
+    class WinRateFile {
+    public:
+        // Opens the file at 'path'. ok() is false if it can not be opened or is not a valid win rate file.
+        explicit WinRateFile(const std::string & path);
+
+        ~WinRateFile();
+
+        bool ok() const { return mapping != NULL; }
+
+        // Number of strategies
+        size_t size() const { return names.size(); }
+
+        // Name of strategy i
+        const std::string & name(size_t i) const { return names[i]; }
+
+        // Win rate of strategy i against strategy j (NaN if their game has not been played)
+        double get(size_t i, size_t j) const;
+
+        // Fills 'win_rates' with the win rates of strategy i against every strategy
+        void row(size_t i, std::vector<double> & win_rates) const;
+
+    private:
+        std::vector<std::string> names;
+        bool single;
+
+        const char * entries;
+        FileMapping * mapping;
+
+        // non-copyable
+        WinRateFile(const WinRateFile &);
+        WinRateFile & operator=(const WinRateFile &);
+    };
+
+#endif
@@ -0,0 +1,101 @@
+#include "stdafx.h"
+#include "lockfile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// *** Implementation of LockedFile class ***
+
+LockedFile::LockedFile(const std::string & path) {
+#ifdef _WIN32
+    handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+        NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    locked = false;
+    if (handle != INVALID_HANDLE_VALUE) {
+        OVERLAPPED ov = {};
+        locked = LockFileEx(handle, LOCKFILE_EXCLUSIVE_LOCK, 0, MAXDWORD, MAXDWORD, &ov) != 0;
+    }
+#else
+    fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    locked = fd >= 0 && flock(fd, LOCK_EX) == 0;
+#endif
+}
+
+LockedFile::~LockedFile() {
+#ifdef _WIN32
+    if (handle == INVALID_HANDLE_VALUE) return;
+    if (locked) {
+        OVERLAPPED ov = {};
+        UnlockFileEx(handle, 0, MAXDWORD, MAXDWORD, &ov);
+    }
+    CloseHandle(handle);
+#else
+    if (fd < 0) return;
+    if (locked) flock(fd, LOCK_UN);
+    close(fd);
+#endif
+}
+
+unsigned long long LockedFile::size() {
+#ifdef _WIN32
+    LARGE_INTEGER file_size;
+    return GetFileSizeEx(handle, &file_size) ? (unsigned long long)file_size.QuadPart : 0;
+#else
+    struct stat st;
+    return fstat(fd, &st) == 0 ? (unsigned long long)st.st_size : 0;
+#endif
+}
+
+bool LockedFile::read_at(unsigned long long offset, void * data, size_t size) {
+    char * p = (char *)data;
+    while (size > 0) {
+#ifdef _WIN32
+        OVERLAPPED ov = {};
+        ov.Offset = (DWORD)offset;
+        ov.OffsetHigh = (DWORD)(offset >> 32);
+        DWORD got = 0;
+        DWORD want = (DWORD)std::min(size, (size_t)(1 << 30));
+        if (!ReadFile(handle, p, want, &got, &ov) || got == 0) return false;
+#else
+        ssize_t got = pread(fd, p, size, (off_t)offset);
+        if (got <= 0) return false;
+#endif
+        p += got; offset += got; size -= got;
+    }
+    return true;
+}
+
+bool LockedFile::write_at(unsigned long long offset, const void * data, size_t size) {
+    const char * p = (const char *)data;
+    while (size > 0) {
+#ifdef _WIN32
+        OVERLAPPED ov = {};
+        ov.Offset = (DWORD)offset;
+        ov.OffsetHigh = (DWORD)(offset >> 32);
+        DWORD put = 0;
+        DWORD want = (DWORD)std::min(size, (size_t)(1 << 30));
+        if (!WriteFile(handle, p, want, &put, &ov) || put == 0) return false;
+#else
+        ssize_t put = pwrite(fd, p, size, (off_t)offset);
+        if (put <= 0) return false;
+#endif
+        p += put; offset += put; size -= put;
+    }
+    return true;
+}
+
+bool LockedFile::resize(unsigned long long size) {
+#ifdef _WIN32
+    LARGE_INTEGER pos;
+    pos.QuadPart = (LONGLONG)size;
+    return SetFilePointerEx(handle, pos, NULL, FILE_BEGIN) && SetEndOfFile(handle);
+#else
+    return ftruncate(fd, (off_t)size) == 0;
+#endif
+}
@@ -1,9 +1,16 @@
 #include "stdafx.h"
 #include "hog.h"
 #include "analysis.h"
+#include "tournament.h"
+#include "simd.h"
+#include "pool.h"
+#include "store.h"
+#include "server.h"
 
 #ifdef _WIN32
 #include <windows.h>
+#else
+#include <unistd.h>
 #endif
 
 #include <signal.h>
@@ -32,7 +39,10 @@ namespace {
     const std::string STORAGE_ROOT = "";
     #endif
 
-    // Path to load extra strategies from
+    // Path to the store of extra strategies
+    const std::string STORE_PATH = std::string(STORAGE_ROOT).append("strategies.dat");
+
+    // Path to the text file extra strategies were kept in before the store (moved into the store on first run)
     const std::string EXT_PATH = std::string(STORAGE_ROOT).append("extras.dat");
 
     // Path to load the stored 'learn' strategy data from
@@ -41,6 +51,15 @@ namespace {
     // Path to load options from
     const std::string OPTIONS_PATH = std::string(STORAGE_ROOT).append("options.dat");
 
+    // Version of the final strategy computation; changing it makes the final strategies kept in the store stale
+    const int FINAL_STRAT_VERSION = 1;
+
+    // Path to the cache of tournament matchup results
+    const std::string MATCHUP_CACHE_PATH = std::string(STORAGE_ROOT).append("matchups.dat");
+
+    // Path of the socket 'bacon serve' listens at, unless the BACON_SOCKET environment variable gives another
+    const std::string SOCKET_PATH = std::string(STORAGE_ROOT).append("bacon.sock");
+
 
     // A map containing all strategies
     std::map<std::string, IStrategy *> strat;
@@ -51,6 +70,10 @@ namespace {
     // Extra strategies added/imported by user
     std::set<std::string> extra_strats;
 
+    /* The store the extra strategies are kept in. Until a stored strategy is first used,
+       its entry in 'strat' is NULL (see get_strat). */
+    StrategyStore * store;
+
 
     // Pointer to the default LearningStrategy instance
     LearningStrategy * learning_strat;
@@ -59,6 +82,9 @@ namespace {
     // indicates if running in interactive mode
     bool interactive_mode = 0;
 
+    // indicates if answering the requests of a server (see serve): commands then never read from cin
+    bool serving = false;
+
     // virtual buffer 
     std::stringstream buf;
 
@@ -78,13 +104,14 @@ namespace {
     // utility functions
     // check if vurtual buffer OR cin buffer has content
     inline bool has_buf() {
-        return (!buf.str().empty()) || std::cin.rdbuf()->in_avail() > 1;
+        return (!buf.str().empty()) || (!serving && std::cin.rdbuf()->in_avail() > 1);
     }
 
     // read in a name from the virtual buffer or, if it is not availble, the cin buffer
     inline int read_token(std::string & read_to) {
         std::string tmp;
         if (buf.str().empty()){
+            if (serving) return false;
             std::cin >> read_to;
             if (std::cin.fail()) return false;
             while (read_to.size() && read_to[read_to.size() - 1] == '\\') {
@@ -108,6 +135,7 @@ namespace {
 
     inline int read_token(int & read_to) {
         if (buf.str().empty()){
+            if (serving) return false;
             std::cin >> read_to;
             return !std::cin.fail();
         }
@@ -121,6 +149,7 @@ namespace {
     // read in a line from the virtual buffer or, if it is not availble, the cin buffer
     inline int read_line(std::string & read_to) {
         if (buf.str().empty()) {
+            if (serving) return false;
     #ifdef _WIN32
             if (interactive_mode) // fix for Windows, do not need to ignore outside interactive mode
     #endif
@@ -159,6 +188,10 @@ namespace {
             output_paths.pop_back();
             return true;
         }
+        else if (serving) {
+            c[0] = '\0';
+            return false;
+        }
         else {
     #ifdef _WIN32
             if (interactive_mode) // fix for Windows, do not need to ignore outside interactive mode
@@ -171,6 +204,44 @@ namespace {
         }
     } // ask_for_path
 
+    /* the final strategy for the current rules: read from the store if it was computed under the same rules before,
+       otherwise computed and kept in the store as a derived strategy */
+    MatrixStrategy * load_final_strat() {
+        std::stringstream key;
+        key << "_final/" << FINAL_STRAT_VERSION << "/" << std::hex << rules_fingerprint();
+
+        MatrixStrategy * fs = store->load_derived(key.str());
+        if (!fs) {
+            fs = create_final_strat(true);
+            if (store->put_derived(key.str(), *fs)) store->commit();
+        }
+
+        fs->name = "_final";
+        return fs;
+    } // load_final_strat
+
+    /* get a strategy by name, loading an extra strategy from the store (or the final strategy, unless overridden)
+       on first use (NULL if there is none). With 'make_final' false, NULL is also returned for a final strategy
+       not loaded yet, which may have to be computed (see final_pending). */
+    inline IStrategy * get_strat(const std::string & name, bool make_final = true) {
+        auto it = strat.find(name);
+        if (it == strat.end()) return NULL;
+
+        if (!it->second) {
+            bool final = name == "_final" && !store->contains(name);
+            if (final && !make_final) return NULL;
+
+            it->second = final ? load_final_strat() : store->load(name);
+        }
+        return it->second;
+    } // get_strat
+
+    // true if the final strategy is in use but not loaded yet (get_strat would load or compute it)
+    inline bool final_pending() {
+        auto it = strat.find("_final");
+        return it != strat.end() && !it->second && !store->contains("_final");
+    } // final_pending
+
     // ask the user for a strategy name
     inline IStrategy & ask_for_strategy(const std::string & msg, bool no_human = false) {
         std::string name;
@@ -199,7 +270,7 @@ namespace {
             
         } while ((no_human && name == "human") || strat.find(name) == strat.end());
 
-        return *strat[name];
+        return *get_strat(name);
     } // ask_for_strategy
 
     // delete and erase an "extra" strategy, making sure to release memory
@@ -230,72 +301,84 @@ namespace {
         ofs.close();
     }
 
-    // load extra strategies
-    void load_exts(const std::string & path) {
-        std::ifstream ext_ifs(EXT_PATH);
+    /* move the strategies of a text file of extra strategies (as written by earlier versions) into the store,
+       renaming the file once they are all in */
+    void migrate_exts(const std::string & path) {
+        std::ifstream ext_ifs(path);
+        if (!ext_ifs) return;
 
         std::string header = "", name = "";
-        
+        bool moved = true;
+
         ext_ifs >> header;
 
         while (header == "strategy") {
             while (ext_ifs.peek() == ' ')
                 ext_ifs.get();
             std::getline(ext_ifs, name);
-            MatrixStrategy * es = new MatrixStrategy(name);
-            for (int i = 0; i < GOAL; ++i) {
-                for (int j = 0; j < GOAL; ++j) {
-                    int tmp; ext_ifs >> tmp;
-                    es->set_roll_num(i, j, tmp);
+            MatrixStrategy es(name);
+            bool valid = true;
+            for (int i = 0; i < GOAL && valid; ++i) {
+                for (int j = 0; j < GOAL && valid; ++j) {
+                    int tmp;
+                    if (!(ext_ifs >> tmp) || tmp < 0 || tmp > MAX_ROLLS) {
+                        std::cout << "Warning: strategy '" << name << "' in '" << path << "' has an invalid roll number at score (" <<
+                            i << ", " << j << ") and was not imported." << std::endl;
+                        valid = false;
+                    }
+                    else {
+                        es.set_roll_num(i, j, tmp);
+                    }
                 }
             }
 
-            delete_erase_extra_strat(name);
+            // a bad value leaves the rest of the file unreadable, so keep it as it is
+            if (!valid) {
+                moved = false;
+                break;
+            }
 
-            strat[name] = es;
-            extra_strats.insert(name);
+            if (!store->put(name, es)) moved = false;
 
             header = "";
             ext_ifs >> header;
         }
 
         ext_ifs.close();
-    } // load_exts
 
-    // write out extra strategies to the path specified
-    void write_exts(const std::string & path) {
-        std::ofstream ext_ofs(EXT_PATH);
-
-        for (auto name : extra_strats) {
-            IStrategy * strategy = strat[name];
-            if (typeid(*strategy) == typeid(MatrixStrategy)) {
-                ext_ofs << "strategy";
-                ext_ofs << " " << name;
-                MatrixStrategy es = *(MatrixStrategy *)strat[name];
-
-                for (int i = 0; i < GOAL; ++i) {
-                    ext_ofs << "\n";
-                    for (int j = 0; j < GOAL; ++j) {
-                        if (j) ext_ofs << " ";
-                        ext_ofs << es.get_roll_num(i, j);
-                    }
-                }
-            }
-            ext_ofs << "\n";
+        if (moved && store->commit()) rename(path.c_str(), (path + ".old").c_str());
+    } // migrate_exts
+
+    // open the store of extra strategies and list them (they are only loaded when used)
+    void load_exts(void) {
+        store = new StrategyStore(STORE_PATH);
+
+        if (!store->ok()) {
+            std::cout << "Warning: could not open the strategy store '" << STORE_PATH <<
+                "'. Imported strategies will not be saved." << std::endl;
+            return;
         }
 
-        ext_ofs.flush();
-        ext_ofs.close();
-    } // write_exts
+        if (store->size() == 0) migrate_exts(EXT_PATH);
+
+        for (const std::string & name : store->names()) {
+            strat[name] = NULL;
+            extra_strats.insert(name);
+        }
+    } // load_exts
 
     /* set up a strategy with the name for use inside the console 
-       (delete old strat with same name, add to 'strat', insert to 'extra_strats', save all strats to file, etc.) */
-    inline void insert_strat_ptr(IStrategy * strategy, std::string name, bool print_strats = false) {
+       (delete old strat with same name, add to 'strat', insert to 'extra_strats', save it to the store, etc.).
+       With 'commit' false, the store is committed by the caller, once for a whole batch.
+       Returns false if the strategy could not be saved to the store. */
+    inline bool insert_strat_ptr(MatrixStrategy * strategy, std::string name, bool print_strats = false, bool commit = true) {
         delete_erase_extra_strat(name);
         strat[name] = strategy;
 
         extra_strats.insert(name);
-        write_exts(EXT_PATH);
+
+        bool saved = !store->ok() || (store->put(name, *strategy) && (!commit || store->commit()));
+        if (!saved) std::cout << "Warning: could not save '" << name << "' to the strategy store." << std::endl;
 
         if (print_strats) {
             print_hline();
@@ -304,6 +387,8 @@ namespace {
             print_hline();
             std::cout << std::endl;
         }
+
+        return saved;
     } // insert_strat_ptr
 
     // List all available commands (hardcoded)
@@ -314,7 +399,8 @@ namespace {
     get (-s) \t\t diff (-d) \t\t graph (-g) \t\t graphdiff (-gd) \n\
     list (-ls) \t\t import (-i [-f]) \t export[py] (-e [-f]) \t clone (-c)\n\
     remove (-rm) \t help (-h) \t\t version (-v) \t\t option (-o) \t\t\n\
-    \t\t\t\t\t\t time \t\t\t exit" << std::endl << std::endl;
+    bestresponse (-br)\t merge \t\t\t swiss \t\t\t time \n\
+    serve \t\t ask \t\t\t exit" << std::endl << std::endl;
     } // show_available_commands
 
     // Announcer for round robin tournament
@@ -323,6 +409,70 @@ namespace {
             " remaining. '" << high_strat << "' is leading with " << high << " wins." << std::endl;
     }
 
+    // Announcer for Swiss-system tournament, after each round
+    void swiss_announcer(int games_played, int games_remaining, int high, std::string high_strat) {
+        std::cout << games_played << " games played, " << games_remaining <<
+            " remaining. '" << high_strat << "' is leading with " << high << " points." << std::endl;
+    }
+
+    /* Print the ranking of a tournament and, unless it is incomplete, write it to 'path' along with the
+       matrix of win rates, ordered by rank ('names' gives the order of the strategies in 'win_rates') */
+    void report_tournament(const std::vector<std::string> & names, std::vector<std::pair<int, std::string>> & results,
+        const WinRateMatrix & win_rates, const char * path, bool incomplete) {
+
+        int rank = 1, ties = 0;
+
+        std::ofstream save_ofs;
+
+        if (!incomplete) {
+            save_ofs.open(path, std::ofstream::out | std::ofstream::trunc);
+            if (save_ofs.fail() || !save_ofs.is_open()) {
+                std::cout << "Could not access the specified path. Please check if the path is correct and if "
+                    "the file is being used. Results will be saved to results.txt in the current directory.\n";
+                save_ofs.clear();
+                save_ofs.open(path, std::ofstream::out | std::ofstream::trunc);
+            }
+        }
+
+        std::map<std::string, int> name_to_rank;
+        std::vector<int> rank_to_index(names.size());
+        for (unsigned i = 0; i < results.size(); ++i) {
+            if (i && results[i].first < results[i - 1].first) {
+                rank += ties;
+                ties = 1;
+            }
+            else {
+                ++ties;
+            }
+            name_to_rank[results[i].second] = i;
+            std::cout << rank << ". " << results[i].second << " with " << results[i].first << " wins \n";
+            if (!incomplete) 
+                save_ofs << rank <<  ". " << results[i].second << " with " << results[i].first << " wins \n";
+        }
+        for (size_t i = 0; i < names.size(); ++i) {
+            rank_to_index[name_to_rank[names[i]]] = i;
+        }
+        if (!incomplete) {
+            save_ofs << "\nWin rates:\n";
+            for (size_t i = 0; i < names.size(); ++i) {
+                for (size_t j = 0; j < names.size(); ++j) {
+                    if (j) save_ofs << ", ";
+                    int ir = rank_to_index[i], jr = rank_to_index[j];
+                    save_ofs << win_rates.get(ir, jr);
+                }
+                save_ofs << "\n";
+            }
+        }
+
+        if (incomplete) 
+            std::cout << "\n(Results are incomplete and so haven't been written to file)\n" << std::endl;
+        else
+            std::cout << "\nResults have been written to '" << path << "'.\n" << std::endl;
+    } // report_tournament
+
+    // Keep everything resident and answer requests over a socket (defined after exec, which it calls)
+    void serve(int tables);
+
     // Execute Bacon command cmd
     void exec(const std::string & cmd){
         // cancel any interrupts
@@ -353,7 +503,7 @@ namespace {
 
             for (auto name : extra_strats) {
                 if (name != "_final")
-                    contestants.push_back(make_pair(name, strat[name]));
+                    contestants.push_back(make_pair(name, get_strat(name)));
             }
 
             size_t total_strats = contestants.size();
@@ -369,8 +519,70 @@ namespace {
             if (!success) return;
             
             if (thds <= 0) thds = 4;
-            
-            if (output_paths.size() == 0) std::cout << "\nFile to save results to when done:" << std::endl;
+
+            /* options: --shard i/N plays the i-th of N slices of the games,
+               --resume continues an interrupted run from its journal,
+               --matrix path also writes the win rates to a binary win rate file as the games finish,
+               --float32 stores the win rates in that file as single precision floats (half the size),
+               --metrics path appends live metrics to a JSON lines file (every --metrics-interval seconds),
+               --similarity plays runs of near-identical opponents by updating one DP table */
+            int shard = 1, shards = 1, metrics_interval = TournamentTelemetry::DEFAULT_INTERVAL;
+            bool resume = false, single = false, similarity = false;
+            std::string matrix_path, metrics_path;
+
+            while (has_buf()) {
+                std::string opt, spec;
+                if (!read_token(opt) || opt.empty()) break;
+
+                if (opt == "--shard") {
+                    read_token(spec);
+
+                    if (sscanf(spec.c_str(), "%d/%d", &shard, &shards) != 2 || shards < 1 || shard < 1 || shard > shards) {
+                        std::cout << "\nInvalid shard '" << spec << "'. Use --shard i/N with 1 <= i <= N.\n" << std::endl;
+                        return;
+                    }
+                }
+                else if (opt == "--resume") {
+                    resume = true;
+                }
+                else if (opt == "--matrix") {
+                    if (!read_token(matrix_path) || matrix_path.empty()) {
+                        std::cout << "\nMissing path after --matrix.\n" << std::endl;
+                        return;
+                    }
+                }
+                else if (opt == "--float32") {
+                    single = true;
+                }
+                else if (opt == "--metrics") {
+                    if (!read_token(metrics_path) || metrics_path.empty()) {
+                        std::cout << "\nMissing path after --metrics.\n" << std::endl;
+                        return;
+                    }
+                }
+                else if (opt == "--metrics-interval") {
+                    if (!read_token(metrics_interval) || metrics_interval <= 0) {
+                        std::cout << "\nInvalid number of seconds after --metrics-interval.\n" << std::endl;
+                        return;
+                    }
+                }
+                else if (opt == "--similarity") {
+                    similarity = true;
+                }
+                else {
+                    std::cout << "\nUnknown option '" << opt << "'. (options: --shard i/N, --resume, --matrix path, --float32, " <<
+                        "--metrics path, --metrics-interval s, --similarity)\n" << std::endl;
+                    return;
+                }
+            }
+
+            if (single && matrix_path.empty()) {
+                std::cout << "\n--float32 only applies to the binary file of --matrix path.\n" << std::endl;
+                return;
+            }
+
+            if (output_paths.size() == 0) 
+                std::cout << "\nFile to save " << (shards > 1 ? "partial " : "") << "results to when done:" << std::endl;
 
             char path[256];
             ask_for_path(path);
@@ -380,74 +592,272 @@ namespace {
             std::cout << "Running tournament..." << std::endl;
 
             std::vector<std::pair<int, std::string>> results;
-            double ** win_rate_mat = new double*[contestants.size()];
-            for (size_t i = 0; i < contestants.size(); ++i) {
-                win_rate_mat[i] = new double[contestants.size()];
+            std::vector<std::string> names;
+            for (auto & c : contestants) names.push_back(c.first);
+
+            // games of other shards are left unplayed
+            std::unique_ptr<WinRateMatrix> win_rates(matrix_path.empty() ? new WinRateMatrix(total_strats) :
+                new WinRateMatrix(matrix_path, names, single));
+
+            if (!win_rates->ok()) {
+                std::cout << "Could not create the win rate file '" << matrix_path << "'.\n" << std::endl;
+                return;
             }
 
-            round_robin(contestants, results, announcer, 100, 0.500001, thds, win_rate_mat, &interrupt);
+            // completed games are journaled next to the output file, so that an interrupted run can be resumed
+            TournamentJournal journal(std::string(path) + ".journal",
+                TournamentJournal::tournament_id(contestants, shard - 1, shards), resume);
 
-            if (interrupt) 
-                std::cout << "\nTournament interrupted by user. Incomplete results:\n\n";
-            else 
-                std::cout << "\nAll games have finished. Final results:\n\n";
+            if (resume) std::cout << "Resuming from " << journal.size() << " completed games." << std::endl;
+            if (!journal.ok()) std::cout << "Warning: could not create the journal '" << path << ".journal'." << std::endl;
 
+            std::unique_ptr<TournamentTelemetry> telemetry;
+            if (!metrics_path.empty()) {
+                telemetry.reset(new TournamentTelemetry(metrics_path, thds, metrics_interval));
+                if (!telemetry->ok()) std::cout << "Warning: could not open the metrics file '" << metrics_path << "'." << std::endl;
+            }
 
-            int rank = 1, ties = 0;
+            MatchupCache cache(MATCHUP_CACHE_PATH, MatchupCache::capacity_for(contestants.size()));
+            RoundRobinOptions options;
+            options.announcer = announcer;
+            options.threads = thds;
+            options.win_rates = win_rates.get();
+            options.interrupt = &interrupt;
+            options.cache = &cache;
+            options.shard = shard - 1;
+            options.shards = shards;
+            options.journal = &journal;
+            options.telemetry = telemetry.get();
+            options.similarity = similarity;
+
+            TournamentStats stats = round_robin(contestants, results, options);
+            telemetry.reset();
+            win_rates->flush();
+
+            std::cout << "\nDistinct strategies: " << stats.distinct_strategies << " of " << total_strats <<
+                "\nGames evaluated: " << stats.games_evaluated << " of " << stats.games << " (" <<
+                stats.games - stats.games_evaluated - stats.games_cached - stats.games_resumed <<
+                " saved by merging equivalent strategies, " << stats.games_cached << " found in the cache, " <<
+                stats.games_resumed << " resumed)" << std::endl;
+
+            if (similarity && stats.games_reused > 0) {
+                long long full = (long long)stats.games_reused * IncrementalWinRate::total_states();
+                std::cout << "DP reuse: " << stats.games_reused << " games evaluated by updating a near-identical game, saving " <<
+                    stats.states_saved << " of " << full << " state evaluations (" << 100.0 * stats.states_saved / full << "%)" << std::endl;
+            }
 
-            std::ofstream save_ofs;
+            if (interrupt) {
+                std::cout << "\nTournament interrupted by user.";
+                if (shards == 1) std::cout << " Incomplete results:";
+                std::cout << "\n\n";
+            }
+            else if (shards == 1) {
+                std::cout << "\nAll games have finished. Final results:\n\n";
+            }
 
-            if (!interrupt) {
-                save_ofs.open(path, std::ofstream::out | std::ofstream::trunc);
-                if (save_ofs.fail() || !save_ofs.is_open()) {
-                    std::cout << "Could not access the specified path. Please check if the path is correct and if "
-                        "the file is being used. Results will be saved to results.txt in the current directory.\n";
-                    save_ofs.clear();
-                    save_ofs.open(path, std::ofstream::out | std::ofstream::trunc);
+            if (shards > 1) {
+                if (interrupt)
+                    std::cout << "(Partial results haven't been written to file)\n" << std::endl;
+                else if (write_shard_results(path, shard - 1, shards, contestants, *win_rates)) {
+                    std::cout << "\nShard " << shard << " of " << shards << " has finished. Partial results have been written to '" << path <<
+                        "'.\nCombine the results of all shards with: bacon merge -f output_file shard_files\n" << std::endl;
+                    journal.remove();
                 }
+                else
+                    std::cout << "\nCould not write to '" << path << "'.\n" << std::endl;
             }
+            else {
+                report_tournament(names, results, *win_rates, path, interrupt != 0);
+                if (!interrupt) journal.remove();
+            }
+
+            if (interrupt && journal.ok())
+                std::cout << "The completed games have been saved. Run the same command with --resume to continue.\n" << std::endl;
+
+            if (!matrix_path.empty())
+                std::cout << "The win rates have been written to the binary file '" << matrix_path << "'.\n" << std::endl;
+        }
+
+        else if (cmd == "merge") {
+            std::cout << "\n--Tournament Merge Tool--" << std::endl;
+
+            // the output file comes first, then the partial results file of each shard
+            std::vector<std::string> shard_paths;
+            char path[256];
+
+            if (output_paths.size() == 0) {
+                int count = 0;
+                std::cout << "\nNumber of shards:" << std::endl;
+                if (!read_token(count)) return;
 
-            std::map<std::string, int> name_to_rank;
-            std::vector<int> rank_to_index(contestants.size());
-            for (unsigned i = 0; i < results.size(); ++i) {
-                if (i && results[i].first < results[i - 1].first) {
-                    rank += ties;
-                    ties = 1;
+                for (int i = 0; i < count; ++i) {
+                    std::string shard_path;
+                    std::cout << "\nPartial results file of shard " << i + 1 << " (enter \\ before spaces):" << std::endl;
+                    if (!read_token(shard_path)) return;
+                    shard_paths.push_back(shard_path);
                 }
-                else {
-                    ++ties;
+
+                std::cout << "\nFile to save results to:" << std::endl;
+            }
+            else {
+                while (output_paths.size() > 1) {
+                    ask_for_path(path);
+                    shard_paths.insert(shard_paths.begin(), path);
                 }
-                name_to_rank[results[i].second] = i;
-                std::cout << rank << ". " << results[i].second << " with " << results[i].first << " wins \n";
-                if (!interrupt) 
-                    save_ofs << rank <<  ". " << results[i].second << " with " << results[i].first << " wins \n";
             }
-            for (size_t i = 0; i < contestants.size(); ++i) {
-                rank_to_index[name_to_rank[contestants[i].first]] = i;
+
+            ask_for_path(path);
+
+            std::vector<std::string> names;
+            WinRateMatrix win_rates;
+            std::string error;
+
+            if (!read_shard_results(shard_paths, names, win_rates, error)) {
+                std::cout << "\nCould not merge the results: " << error << ".\n" << std::endl;
+                return;
+            }
+
+            std::vector<std::pair<int, std::string>> results;
+            count_victories(names, win_rates, results);
+
+            std::cout << "\nMerged " << shard_paths.size() << " shards. Final results:\n\n";
+            report_tournament(names, results, win_rates, path, false);
+        }
+
+        else if (cmd == "swiss") {
+            std::cout << "\n--Swiss-system Tournament Tool--" << std::endl;
+
+            std::vector<std::pair<std::string, IStrategy *> > contestants;
+
+            for (auto name : extra_strats) {
+                if (name != "_final")
+                    contestants.push_back(make_pair(name, get_strat(name)));
             }
-            if (!interrupt) {
-                save_ofs << "\nWin rates:\n";
-                for (size_t i = 0; i < contestants.size(); ++i) {
-                    for (size_t j = 0; j < contestants.size(); ++j) {
-                        if (j) save_ofs << ", ";
-                        int ir = rank_to_index[i], jr = rank_to_index[j];
-                        if (ir == jr) win_rate_mat[ir][jr] = 0.5;
-                        save_ofs << win_rate_mat[ir][jr];
+
+            size_t total_strats = contestants.size();
+
+            // enough rounds to single out a winner, and a couple more to sort out the places behind it
+            int rounds = 2;
+            while (total_strats > 1 && (size_t)1 << (rounds - 2) < total_strats) ++rounds;
+            rounds = (int)std::min((size_t)rounds, std::max(total_strats, (size_t)2) - 1);
+
+            std::cout << "Number of strategies: " << total_strats << "\n";
+
+            if (output_paths.size() == 0) std::cout << "\nNumber of threads:" << std::endl;
+
+            int thds = 4;
+            if (!read_token(thds)) return;
+            if (thds <= 0) thds = 4;
+
+            /* options: --rounds n plays n rounds,
+               --top k reports the stability of the top k (default 10),
+               --validate n also plays a round robin and a Swiss tournament on n of the strategies (evenly spaced),
+               and compares their top k,
+               --metrics path appends live metrics to a JSON lines file (every --metrics-interval seconds) */
+            int top = 10, validate = 0, metrics_interval = TournamentTelemetry::DEFAULT_INTERVAL;
+            std::string metrics_path;
+
+            while (has_buf()) {
+                std::string opt;
+                if (!read_token(opt) || opt.empty()) break;
+
+                if (opt == "--metrics") {
+                    if (!read_token(metrics_path) || metrics_path.empty()) {
+                        std::cout << "\nMissing path after --metrics.\n" << std::endl;
+                        return;
                     }
-                    save_ofs << "\n";
+                    continue;
                 }
+
+                int * value = opt == "--rounds" ? &rounds : opt == "--top" ? &top : opt == "--validate" ? &validate :
+                    opt == "--metrics-interval" ? &metrics_interval : NULL;
+                if (!value) {
+                    std::cout << "\nUnknown option '" << opt << "'. (options: --rounds n, --top k, --validate n, " <<
+                        "--metrics path, --metrics-interval s)\n" << std::endl;
+                    return;
+                }
+                if (!read_token(*value) || *value <= 0) {
+                    std::cout << "\nInvalid value after " << opt << ".\n" << std::endl;
+                    return;
+                }
+            }
+
+            std::cout << "Rounds: " << rounds << " (about " << rounds * (total_strats / 2) << " games)\n";
+
+            if (output_paths.size() == 0) std::cout << "\nFile to save results to when done:" << std::endl;
+
+            char path[256];
+            ask_for_path(path);
+
+            std::cout << "\nRunning tournament..." << std::endl;
+
+            std::unique_ptr<TournamentTelemetry> telemetry;
+            if (!metrics_path.empty()) {
+                telemetry.reset(new TournamentTelemetry(metrics_path, thds, metrics_interval));
+                if (!telemetry->ok()) std::cout << "Warning: could not open the metrics file '" << metrics_path << "'." << std::endl;
             }
 
-            if (interrupt) 
+            MatchupCache cache(MATCHUP_CACHE_PATH, MatchupCache::capacity_for(contestants.size()));
+            std::vector<SwissStanding> standings;
+            TournamentStats stats = swiss(contestants, standings, rounds, swiss_announcer, 0.500001, thds, &interrupt, &cache,
+                telemetry.get());
+            telemetry.reset();
+
+            std::cout << "\nDistinct strategies: " << stats.distinct_strategies << " of " << total_strats <<
+                "\nGames evaluated: " << stats.games_evaluated << " of " << stats.games << " (" <<
+                stats.games_cached << " found in the cache)" << std::endl;
+
+            if (interrupt) std::cout << "\nTournament interrupted by user. Standings after the last complete round:\n\n";
+            else std::cout << "\nAll rounds have finished. Final standings:\n\n";
+
+            std::ofstream save_ofs;
+            if (!interrupt) save_ofs.open(path, std::ofstream::out | std::ofstream::trunc);
+
+            for (size_t i = 0; i < standings.size(); ++i) {
+                std::stringstream line;
+                line << i + 1 << ". " << standings[i].name << " with " << standings[i].points << " points (rating " <<
+                    std::fixed << std::setprecision(1) << standings[i].rating << ", " << standings[i].games << " games)\n";
+                std::cout << line.str();
+                if (save_ofs.is_open()) save_ofs << line.str();
+            }
+
+            if (interrupt)
                 std::cout << "\n(Results are incomplete and so haven't been written to file)\n" << std::endl;
-            else
+            else if (save_ofs.is_open())
                 std::cout << "\nResults have been written to '" << path << "'.\n" << std::endl;
+            else
+                std::cout << "\nCould not write to '" << path << "'.\n" << std::endl;
 
-            for (size_t i = 0; i < contestants.size(); ++i) {
-                delete[] win_rate_mat[i];
-            }
-            delete[] win_rate_mat;
+            if (validate && !interrupt) {
+                // an evenly spaced sample of the strategies
+                size_t n = std::min((size_t)validate, total_strats);
+                std::vector<std::pair<std::string, IStrategy *> > field;
+                for (size_t i = 0; i < n; ++i) field.push_back(contestants[i * total_strats / n]);
+
+                std::cout << "Validating on " << n << " strategies: running a round robin..." << std::endl;
+
+                std::vector<std::pair<int, std::string>> victories;
+                RoundRobinOptions options;
+                options.threads = thds;
+                options.interrupt = &interrupt;
+                options.cache = &cache;
+                round_robin(field, victories, options);
+
+                std::cout << "Running a Swiss-system tournament of " << rounds << " rounds..." << std::endl;
 
+                std::vector<SwissStanding> field_standings;
+                swiss(field, field_standings, rounds, NULL, 0.500001, thds, &interrupt, &cache);
+
+                if (!interrupt) {
+                    std::vector<std::string> ranking;
+                    for (auto & s : field_standings) ranking.push_back(s.name);
+
+                    int k = (int)std::min((size_t)top, n);
+                    std::cout << "\nTop-" << k << " stability: " << top_k_agreement(ranking, victories, k) << " of the Swiss top " << k <<
+                        " are in the top " << k << " of the round robin. Winners: '" << ranking[0] << "' (Swiss), '" <<
+                        victories[0].second << "' (round robin)\n" << std::endl;
+                }
+            }
         }
 
         // learning
@@ -488,9 +898,14 @@ namespace {
             IStrategy & s0 = ask_for_strategy("\nPlayer 0 strategy name (enter \\ before spaces):", true);
             IStrategy & s1 = ask_for_strategy("\nPlayer 1 strategy name (enter \\ before spaces):", true);
 
+            // optional number of threads to split the computation across
+            int thds = 1;
+            if (has_buf()) read_token(thds);
+            if (thds <= 0) thds = 1;
+
             double rate = average_win_rate(s0, s1,
                 ((cmd == "-r" || cmd == "winrate") ? -1 : ((cmd == "-r1" || cmd == "winrate1") ? 1 : 0)),
-                0, 0, 0);
+                0, 0, 0, 0, thds);
 
             std::cout << "Win rate: " << rate << "\n" << std::endl;
         }
@@ -599,11 +1014,46 @@ namespace {
             } while (name.length() == 0 && read_token(name) && !interrupt);
             if (interrupt) {interrupt = false; return;}
 
-            MatrixStrategy * opti_strat = create_final_strat();
+            TurnPolicy * policy = new TurnPolicy();
+            MatrixStrategy * opti_strat = create_final_strat(false, policy);
+
+            // optionally write the turn-aware policy the strategy was derived from
+            if (output_paths.size()) {
+                char path[256];
+                ask_for_path(path);
+                policy->write_to_file(path);
+                std::cout << "Turn-aware policy table written to '" << path << "'." << std::endl;
+            }
+            delete policy;
 
             insert_strat_ptr(opti_strat, name, true);
         }
 
+        else if (cmd == "-br" || cmd == "bestresponse") {
+            IStrategy & s0 = ask_for_strategy("\nOpponent strategy name (enter \\ before spaces):", true);
+
+            std::string name;
+            do {
+                if (!has_buf())
+                    std::cout << "\nName to use for the best response (use '" << LEARNING_STRATEGY_NAME <<
+                    "' to seed training from it)\n(Warning: using the name of an " <<
+                    "existing strategy will override that strategy!):\n\n";
+            } while (name.length() == 0 && read_token(name) && !interrupt);
+            if (interrupt) {interrupt = false; return;}
+
+            if (name == LEARNING_STRATEGY_NAME) {
+                learning_strat->seed_best_response(s0);
+                std::cout << "Strategy 'learn' overwritten with the best response. " <<
+                    "Run 'train' to refine it.\n" << std::endl;
+                return;
+            }
+
+            MatrixStrategy * best = create_best_response(s0);
+
+            std::cout << "Best response saved to " << name << "." << std::endl;
+            insert_strat_ptr(best, name, true);
+        }
+
         else if (cmd == "mkrandom") {
             std::string name;
             do {
@@ -650,7 +1100,7 @@ namespace {
                 auto it = strat.find(name);
                 if (it != strat.end()) {
                     // found!
-                    MatrixStrategy tmpcs = MatrixStrategy(*it->second, name);
+                    MatrixStrategy tmpcs = MatrixStrategy(*get_strat(name), name);
 
                     if (output_paths.size() == 0) std::cout << "\nExport file path:" << std::endl;
 
@@ -684,59 +1134,96 @@ namespace {
         else if (cmd == "-i" || cmd == "import") {
             std::cout << "\n--Strategy Import Tool--\n";
 
-            bool single_mode = (output_paths.size() == 0);
-            if (single_mode) std::cout << "Please enter the strategy file path:" << std::endl;
-
-            int ct = 0;
+            if (output_paths.size() == 0) {
+                std::cout << "Please enter the strategy file path:" << std::endl;
 
-            do {
                 char path[256];
                 int success = ask_for_path(path);
-                
-                if (interrupt || !success) break;
+                if (interrupt || !success) {interrupt = false; return;}
+
+                MatrixStrategy * strategy = new MatrixStrategy();
+                std::string error;
+
+                if (!strategy->load_from_file(path, &error)) {
+                    std::cout << "Import failed: " << error << ".\n\n";
+                    delete strategy;
+                    return;
+                }
+
+                std::string name = strategy->name;
+                while (name.length() == 0 || name == LEARNING_STRATEGY_NAME) {
+                    if (name == LEARNING_STRATEGY_NAME) std::cout << "The name '_learn' is reserved.\n";
+                    std::cout << "\nName to use for this strategy\n(Warning: using the name of an existing strategy will override that strategy!):\n\n";
+                    name = "";
+                    if (!read_token(name) || interrupt) {interrupt = false; delete strategy; return;}
+                }
+                strategy->name = name;
+
+                insert_strat_ptr(strategy, name, true);
+                std::cout << "1 strategy imported.\n" << std::endl;
+                return;
+            }
+
+            /* import every file given with -f as one batch: parse the files in parallel, then add the valid ones
+               (named by their header, or else by the file name) and commit the store once */
+            std::vector<std::string> paths;
+            while (output_paths.size()) {
+                paths.push_back(output_paths.back());
+                output_paths.pop_back();
+            }
+
+            std::vector<std::unique_ptr<MatrixStrategy> > parsed(paths.size());
+            std::vector<std::string> errors(paths.size());
+
+            int threads = (int)std::min((size_t)std::max(std::thread::hardware_concurrency(), 1u), paths.size());
+            worker_pool(threads).run([&](int worker, int workers) {
+                for (size_t k = worker; k < paths.size(); k += workers) {
+                    parsed[k].reset(new MatrixStrategy());
+                    if (!parsed[k]->load_from_file(paths[k], &errors[k])) parsed[k].reset();
+                }
+            });
 
-                std::string name;
-                if (!single_mode) {
-                    name = std::string(path);
+            int ct = 0, failed = 0;
+
+            for (size_t k = 0; k < paths.size(); ++k) {
+                if (parsed[k] && parsed[k]->name.empty()) {
+                    std::string name = paths[k];
 
                     size_t pos = name.find_last_of("\\/");
                     if (pos != name.npos) name = name.substr(pos + 1);
 
                     size_t pos2 = name.find_last_of('.');
                     if (pos2 != name.npos) name = name.substr(0, pos2);
-                }
 
-                MatrixStrategy * strategy = new MatrixStrategy();
+                    parsed[k]->name = name;
+                }
 
-                if (strategy->load_from_file(path)) {
-                    if (strategy->name.size() == 0) {
-                        while (name.length() == 0) {
-                            std::cout << "\nName to use for this strategy\n(Warning: using the name of an existing strategy will override that strategy!):\n\n";
-                            read_token(name);
-                            if (name == LEARNING_STRATEGY_NAME) {
-                                std::cout << "The name '_learn' is reserved.\n";
-                                name = "";
-                            }
-                        }
-                        strategy->name = name;
-                    }
-                    ++ct;
-                    insert_strat_ptr(strategy, strategy->name, single_mode);
+                if (parsed[k] && parsed[k]->name == LEARNING_STRATEGY_NAME) {
+                    parsed[k].reset();
+                    errors[k] = "the name '_learn' is reserved";
                 }
-                else {
-                    std::cout << "Import failed. Please check if the file path is correct.\n\n";
+                else if (parsed[k] && parsed[k]->name.size() > StrategyStore::MAX_NAME) {
+                    parsed[k].reset();
+                    errors[k] = "the name is too long";
                 }
 
-            } while (output_paths.size() > 0);
-            
-            if (interrupt) {interrupt = false; return;}
+                if (!parsed[k]) {
+                    std::cout << "Skipped '" << paths[k] << "': " << errors[k] << ".\n";
+                    ++failed;
+                    continue;
+                }
 
-            if (ct) {
-                if (single_mode || ct == 1)
-                    std::cout << ct << " strategy imported.\n" << std::endl;
-                else
-                    std::cout << ct << " strategies imported.\n" << std::endl;
+                std::string name = parsed[k]->name;
+                if (insert_strat_ptr(parsed[k].release(), name, false, false)) ++ct;
+                else ++failed;
             }
+
+            if (!store->commit() && store->ok())
+                std::cout << "Warning: could not write the strategy store to disk." << std::endl;
+
+            std::cout << ct << (ct == 1 ? " strategy" : " strategies") << " imported";
+            if (failed) std::cout << ", " << failed << (failed == 1 ? " file" : " files") << " skipped";
+            std::cout << ".\n" << std::endl;
         }
 
         else if (cmd == "-rm" || cmd == "remove") {
@@ -774,15 +1261,17 @@ namespace {
                         }
                         
                         extra_strats.clear();
+                        store->clear();
                     }
                     else{	
                         // found single match
                         extra_strats.erase(it);
                         delete strat[name];
                         strat.erase(name);
+                        store->remove(name);
                     }
 
-                    write_exts(EXT_PATH);
+                    store->commit();
                     
                     if (erase_all)
                         std::cout << "All imported strategies removed.\n";
@@ -840,7 +1329,8 @@ namespace {
                 "\n(c) Alex Yu 2017\n\nSwine Swap: " <<
                 (enable_swine_swap ? "Enabled" : "Disabled") <<
                 "\nTime Trot: " <<
-                (enable_time_trot ? "Enabled" : "Disabled") << "\n" << std::endl;
+                (enable_time_trot ? "Enabled" : "Disabled") <<
+                "\nVector instructions: " << simd_name() << "\n" << std::endl;
         }
 
         else if (cmd == "-o" || cmd == "option") {
@@ -897,9 +1387,24 @@ namespace {
 
             write_options();
 
+            // the final strategy depends on the rules, so it is loaded again when next used (unless overridden)
+            if (extra_strats.count("_final") && !store->contains("_final")) {
+                delete strat["_final"];
+                strat["_final"] = NULL;
+            }
+
             std::cout << "\nOption '" << name << "' set to " << value << "\n" << std::endl;
         }
 
+        else if (cmd == "serve") {
+            // number of win rate requests answered at once, each with a DP table of its own
+            int tables = std::max((int)std::thread::hardware_concurrency(), 1);
+            if (has_buf()) read_token(tables);
+            if (tables <= 0) tables = 1;
+
+            serve(tables);
+        }
+
         else if (cmd == "time") {
             std::string command;
             if (!has_buf()) std::cout << "Command to measure:";
@@ -929,18 +1434,28 @@ namespace {
             if (cmd == "-h" || cmd == "help") {
                 std::cout << "--The Game of Hog--\n\
     play (-p): simulate a game of Hog between two strategies (or play against one of them).\n\
-    tournament (-t): run a tournament with all the imported strategies. Use the -f switch to specify output file path: bacon -t -f output.txt\n\n\
+    tournament (-t): run a tournament with all the imported strategies. Use the -f switch to specify output file path: bacon -t -f output.txt\n\
+    \tTo split a tournament across processes, run each slice with --shard i/N: bacon -t 4 --shard 1/3 -f part1.txt\n\
+    \tTo continue an interrupted tournament, run it again with --resume: bacon -t 4 --resume -f output.txt\n\
+    \tTo also write the win rates to a binary file as the games finish, add --matrix path (and --float32 to halve its size)\n\
+    \tTo write live throughput, memory and ETA to a JSON lines file for monitoring, add --metrics path (every 5 s; --metrics-interval s)\n\
+    \tTo reuse DP work between opponents that differ in only a few cells (e.g. tuned variants), add --similarity\n\
+    merge: combine the partial results of all shards of a tournament: bacon merge -f output.txt part1.txt part2.txt part3.txt\n\
+    swiss: run a Swiss-system tournament, for fields too large for a round robin: bacon swiss 4 --rounds 12 -f output.txt\n\
+    \tTo check how well it agrees with a round robin, add --validate n (compares the top 10 on n of the strategies; --top k to change)\n\n\
     \
     --Learning--\n\
     train (-l): start training against a specified strategy (improves the '_learn' strategy).\n\
     learnfrom(-lf): sets the '_learn' strategy to a copy of the specified strategy. The 'train' command will now train this new strategy.\n\n\
     \
     --Strategic Analysis--\n\
-    winrate (-r): get the theoretical win rate of a strategy against another one.\n\
+    winrate (-r): get the theoretical win rate of a strategy against another one. Optionally specify a number of threads to use: bacon -r final swap 8\n\
     avgwinrate: get the average win rate of a strategy against another one using sampling.\n\
     winrate0 (-r0), winrate1 (-r1), avgwinrate0, avgwinrate1: force the first strategy to play as player #.\n\n\
-    mkfinal: re-compute the 'final' strategy; saves the result to the specified strategy name.\n\
-    mkrandom: creates a randomized strategy and saves the result to the specified strategy name.\n\n\
+    mkfinal: re-compute the 'final' strategy; saves the result to the specified strategy name. Use the -f switch to also save the turn-aware optimal policy: bacon mkfinal final -f policy.txt\n\
+    mkrandom: creates a randomized strategy and saves the result to the specified strategy name.\n\
+    bestresponse (-br): computes the best response to a strategy and saves it to the specified strategy name: bacon -br swap counter\n\
+    \tUse the name _learn to seed training from it: bacon -br swap _learn\n\n\
     get (-s): see what a given strategy would roll at a given set of scores.\n\
     diff (-d): get the differences in between two strategies.\n\
     graph (-g): get a graphic representation of a strategy.\n\
@@ -949,6 +1464,7 @@ namespace {
     --Strategy Manager--\n\
     list (-ls): show a list of available strategies. \n\
     import (-i): add a new strategy from a file. Use the -f switch to specify import file path(s): bacon -i mystrategy -f a.strat\n\
+    \tMany files are imported at once, in parallel; files that are not valid strategies are reported and skipped: bacon -i -f strats/*.strat\n\
     export (-e): export a strategy to a file. Use the -f switch parameter to specify output file path: bacon -o final -f final.strat \n\
     exportpy: export a strategy to a Python script that defines a function called 'strategy'.\n\
     clone (-c): clones an existing strategy and saves a cached copy of it to a new name.\n\
@@ -959,6 +1475,9 @@ namespace {
     version (-v): display the version number.\n\
     option (-o): adjust options (turn on/off Swine Swap, Time Trot).\n\
     time: measure the runtime of any bacon command.\n\
+    serve: keep strategies and tables loaded and answer winrate, tournament, swiss, import, bestresponse and list requests\n\
+    \tover a local socket (~/.bacon/bacon.sock, or $BACON_SOCKET), optionally with the number of win rates to compute at once: bacon serve 4\n\
+    ask: send a command to a running server and print the answer: bacon ask -r _final _swap\n\
     exit: get out of here!\n";
                 std::cout << std::endl;
             }
@@ -966,6 +1485,316 @@ namespace {
 
     } // exec
 
+    /* Lets the win rate requests of a server (see serve) run side by side, each on a DP table of its own
+       (see resize_win_rate_storage) and, when it asks for several threads, a worker pool of its own (see worker_pool),
+       while every other request, which may change the strategies or the tables, runs alone.
+       Requests waiting to run alone hold back new win rate requests. */
+    class RequestGate {
+    public:
+        explicit RequestGate(int tables) : tables(tables), exclusive(false), waiting(0) {
+            for (int t = tables; t-- > 0;) free_tables.push_back(t);
+        }
+
+        // Waits until a win rate request may run, and returns the DP table (thread id) it is to use
+        int enter_shared() {
+            std::unique_lock<std::mutex> lck(mtx);
+            cv.wait(lck, [this]() { return !exclusive && !waiting && !free_tables.empty(); });
+
+            int t = free_tables.back();
+            free_tables.pop_back();
+            return t;
+        }
+
+        void leave_shared(int table) {
+            std::lock_guard<std::mutex> lck(mtx);
+            free_tables.push_back(table);
+            cv.notify_all();
+        }
+
+        // Waits until no other request is running
+        void enter_exclusive() {
+            std::unique_lock<std::mutex> lck(mtx);
+            ++waiting;
+            cv.wait(lck, [this]() { return !exclusive && (int)free_tables.size() == tables; });
+            --waiting;
+            exclusive = true;
+        }
+
+        void leave_exclusive() {
+            std::lock_guard<std::mutex> lck(mtx);
+            exclusive = false;
+            cv.notify_all();
+        }
+
+    private:
+        int tables;
+        bool exclusive;
+        int waiting;
+        std::vector<int> free_tables;
+
+        std::mutex mtx;
+        std::condition_variable cv;
+    };
+
+    /* Collects what a served command prints, for its reply: both std::cout and std::cerr (for warnings) go to it.
+       Threads of the command (such as those of a parallel import) may print at once, so every write is locked. */
+    class ReplyBuffer : public std::streambuf {
+    public:
+        std::string str() {
+            std::lock_guard<std::mutex> lck(mtx);
+            return text;
+        }
+
+    protected:
+        int overflow(int c) {
+            if (c == traits_type::eof()) return traits_type::not_eof(c);
+
+            std::lock_guard<std::mutex> lck(mtx);
+            text += traits_type::to_char_type(c);
+            return c;
+        }
+
+        std::streamsize xsputn(const char * s, std::streamsize n) {
+            std::lock_guard<std::mutex> lck(mtx);
+            text.append(s, (size_t)n);
+            return n;
+        }
+
+    private:
+        std::string text;
+        std::mutex mtx;
+    };
+
+    // Number of win rate requests the server answers at once
+    int serve_tables = 1;
+
+    // Gate of the requests of the server
+    RequestGate * gate = NULL;
+
+    // Serializes the strategy lookups of win rate requests, which may load strategies from the store
+    std::mutex lookup_mtx;
+
+    // path of the socket the server listens at
+    std::string socket_path() {
+        const char * path = std::getenv("BACON_SOCKET");
+        return path && *path ? std::string(path) : SOCKET_PATH;
+    }
+
+    // reply to a request the server refused, with the reason
+    std::string refuse_request(const std::string & reason) {
+        return "1" + reason + "\n";
+    }
+
+    /* keep what requests use resident between requests: the DP tables of the win rate requests
+       (which a tournament resizes) and the final strategy (whose computation needs the first table) */
+    void prepare_serving() {
+        resize_win_rate_storage(serve_tables);
+        get_strat("_final");
+    }
+
+    // Answers a win rate request (command, two strategy names and optionally a number of threads) of the server
+    std::string serve_winrate(const std::vector<std::string> & args) {
+        if (args.size() < 3)
+            return refuse_request("Usage: " + args[0] + " strategy0 strategy1 [threads]");
+
+        // at most one thread per core: a client can not make the server start any more
+        int cores = std::max((int)std::thread::hardware_concurrency(), 1);
+        long asked = args.size() > 3 ? std::strtol(args[3].c_str(), NULL, 10) : 1;
+        int thds = (int)std::max(1L, std::min(asked, (long)cores));
+
+        const std::string & cmd = args[0];
+        int plays_as = (cmd == "-r" || cmd == "winrate") ? -1 : ((cmd == "-r1" || cmd == "winrate1") ? 1 : 0);
+
+        int table;
+        IStrategy * s0, * s1;
+        while (true) {
+            table = gate->enter_shared();
+
+            bool pending;
+            {
+                std::lock_guard<std::mutex> lck(lookup_mtx);
+                s0 = get_strat(args[1], false);
+                s1 = get_strat(args[2], false);
+                pending = (args[1] == "_final" || args[2] == "_final") && final_pending();
+            }
+            if (!pending) break;
+
+            /* the final strategy is computed on the first DP table and saved to the store,
+               so that only happens alone; then look again */
+            gate->leave_shared(table);
+            gate->enter_exclusive();
+            get_strat("_final");
+            gate->leave_exclusive();
+        }
+
+        if (!s0 || !s1) {
+            gate->leave_shared(table);
+            return refuse_request("Strategy '" + (s0 ? args[2] : args[1]) + "' not found.");
+        }
+
+        double rate = average_win_rate(*s0, *s1, plays_as, 0, 0, 0, table, thds);
+        gate->leave_shared(table);
+
+        std::stringstream out;
+        out << "0Win rate: " << rate << "\n";
+        if (asked > cores) out << "(on " << cores << " threads, one per core)\n";
+        out << std::endl;
+        return out.str();
+    }
+
+    /* Answers any other request of the server by running the command as 'bacon' would with the same arguments,
+       alone, and replying with what it printed, warnings on stderr included */
+    std::string serve_command(const std::vector<std::string> & args) {
+        gate->enter_exclusive();
+
+        // the arguments go to the virtual buffer (spaces escaped), paths after -f to the list of paths
+        std::vector<std::string> paths;
+        bool fpath_param = false;
+
+        buf.str("");
+        buf.clear();
+        for (size_t i = 1; i < args.size(); ++i) {
+            if (args[i] == "-f") {
+                fpath_param = true; continue;
+            }
+
+            if (fpath_param) {
+                paths.push_back(args[i]);
+            }
+            else {
+                if (buf.tellp() > 0) buf << " ";
+                for (char c : args[i]) {
+                    if (c == ' ') buf << '\\';
+                    buf << c;
+                }
+            }
+        }
+        for (auto & path : paths) output_paths.push_back(&path[0]);
+
+        ReplyBuffer out;
+        std::streambuf * console = std::cout.rdbuf(&out), * console_err = std::cerr.rdbuf(&out);
+        exec(args[0]);
+        std::cout.rdbuf(console);
+        std::cerr.rdbuf(console_err);
+
+        buf.str("");
+        buf.clear();
+        output_paths.clear();
+
+        prepare_serving();
+        gate->leave_exclusive();
+
+        return "0" + out.str();
+    }
+
+    /* Answers a request of the server. A request is a command line of 'bacon' (the command and its arguments,
+       -f and paths included), each argument followed by a '\0'. The reply is '0' followed by what the command
+       printed, or '1' followed by the reason the request was refused. */
+    std::string serve_request(const std::string & request) {
+        std::vector<std::string> args;
+        for (size_t start = 0; start < request.size();) {
+            size_t end = request.find('\0', start);
+            if (end == request.npos) end = request.size();
+            args.push_back(request.substr(start, end - start));
+            start = end + 1;
+        }
+
+        if (args.empty()) return refuse_request("Empty request.");
+
+        for (auto & arg : args) {
+            if (arg == "_human") return refuse_request("The strategy '_human' can not be used by the server.");
+        }
+
+        const std::string & cmd = args[0];
+
+        if (cmd == "-r" || cmd == "-r0" || cmd == "-r1" || cmd == "winrate" || cmd == "winrate0" || cmd == "winrate1")
+            return serve_winrate(args);
+
+        // the results file can not be asked for, so it must be given
+        if (cmd == "-t" || cmd == "tournament" || cmd == "swiss") {
+            auto f = std::find(args.begin(), args.end(), "-f");
+            if (f == args.end() || f + 1 == args.end() || f[1].empty())
+                return refuse_request("A served " + cmd + " needs the path of its results file: " + cmd + " ... -f path");
+        }
+
+        if (cmd == "-t" || cmd == "tournament" || cmd == "swiss" || cmd == "-i" || cmd == "import" ||
+            cmd == "-br" || cmd == "bestresponse" || cmd == "-ls" || cmd == "list")
+            return serve_command(args);
+
+        return refuse_request("Command '" + cmd + "' is not served. (commands: winrate[0|1] (-r), tournament (-t), swiss, " +
+            "import (-i), bestresponse (-br), list (-ls))");
+    }
+
+    /* Keep the strategies, the DP tables and the worker pool resident and answer requests at the server socket
+       until interrupted, 'tables' win rate requests at once */
+    void serve(int tables) {
+        std::string path = socket_path();
+
+        serve_tables = tables;
+        gate = new RequestGate(tables);
+        serving = true;
+        prepare_serving();
+
+        {
+            SocketServer server(path, serve_request);
+
+            if (server.ok()) {
+                std::cout << "Listening at '" << path << "', answering up to " << tables <<
+                    " win rate requests at once. Press Ctrl+C to stop.\n" << std::endl;
+                server.run(&interrupt);
+                std::cout << "\nServer stopped.\n" << std::endl;
+            }
+            else {
+                std::cout << "Could not listen at '" << path << "': " << server.error() << ".\n" << std::endl;
+            }
+        }
+
+        serving = false;
+        delete gate;
+        gate = NULL;
+        resize_win_rate_storage(1);
+    } // serve
+
+    /* Send a command line to a running server (see serve) and print its reply, without loading anything.
+       Paths after -f are made absolute, since the server may run elsewhere. Returns the exit code. */
+    int ask_server(int argc, char * argv[]) {
+        if (argc < 1) {
+            std::cout << "Usage: bacon ask command [arguments] [-f paths]\n" << std::endl;
+            return 1;
+        }
+
+        std::string request;
+        bool fpath_param = false;
+
+        for (int i = 0; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "-f") {
+                fpath_param = true;
+            }
+            else if (fpath_param) {
+    #ifdef _WIN32
+                char full[_MAX_PATH];
+                if (_fullpath(full, arg.c_str(), _MAX_PATH)) arg = full;
+    #else
+                char cwd[4096];
+                if (arg[0] != '/' && getcwd(cwd, sizeof cwd)) arg = std::string(cwd) + "/" + arg;
+    #endif
+            }
+
+            request += arg;
+            request += '\0';
+        }
+
+        std::string reply, error;
+        if (!send_request(socket_path(), request, reply, &error) || reply.empty()) {
+            std::cout << "Could not get an answer from the server: " << (error.empty() ? "empty reply" : error) << ".\n" << std::endl;
+            return 1;
+        }
+
+        std::cout << reply.substr(1) << std::flush;
+        return reply[0] == '0' ? 0 : 1;
+    } // ask_server
+
     inline void init_console(void) {
         srand((unsigned int)time(NULL));
 
@@ -995,13 +1824,12 @@ namespace {
             builtin_strats[pair.first] = pair.second;
         }
 
-        // load extra strategies
-        load_exts(EXT_PATH);
+        // list extra strategies
+        load_exts();
 
-        // create final strategy, if it is not in the cache/has been overridden
+        // list the final strategy, unless it has been overridden; it is only computed when first used (see get_strat)
         if (extra_strats.find("_final") == extra_strats.end()) {
-            MatrixStrategy * cached_fs = create_final_strat(true);
-            strat["_final"] = cached_fs;
+            strat["_final"] = NULL;
 
             // allow removal of final strategy
             extra_strats.insert("_final");
@@ -1012,11 +1840,11 @@ namespace {
 int main(int argc, char * argv[]) {
     signal(SIGINT, int_handler);
 
-    // initialize
-    init_console();
-
     // speed up cin
     std::cin.sync_with_stdio(0);
+
+    // a client of a running server only sends its command line
+    if (argc > 1 && strcmp(argv[1], "ask") == 0) return ask_server(argc - 2, argv + 2);
 		
     #ifdef _WIN32
             // Windows only
@@ -1031,6 +1859,9 @@ int main(int argc, char * argv[]) {
             system((std::string("mkdir -p ") + STORAGE_ROOT).c_str());
     #endif    
 
+    // initialize (once the storage directory exists, so that the strategy store can be created in it)
+    init_console();
+
     if (argc <= 1) { // interactive mode
 
         std::string cmd;
@@ -1072,7 +1903,6 @@ int main(int argc, char * argv[]) {
     }
 
     learning_strat->write_to_file(LEARN_PATH); // save learning strategy
-    write_exts(EXT_PATH); // write out extra strategies
     write_options();
 
     // clean up
@@ -1086,5 +1916,7 @@ int main(int argc, char * argv[]) {
         }
     }
 
+    delete store; // syncs the store
+
     return 0;
 } // main
@@ -0,0 +1,121 @@
+#include "stdafx.h"
+#include "mapping.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// hide from linkage
+namespace {
+    // Maps m->size bytes of the open file m->file (m->fd). Returns false on error.
+    bool map_view(FileMapping * m) {
+    #ifdef _WIN32
+        unsigned long long size64 = m->size;
+        m->map = CreateFileMappingA(m->file, NULL, m->write ? PAGE_READWRITE : PAGE_READONLY,
+            (DWORD)(size64 >> 32), (DWORD)size64, NULL);
+        if (!m->map) return false;
+
+        m->data = (char *)MapViewOfFile(m->map, m->write ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, m->size);
+        return m->data != NULL;
+    #else
+        void * data = mmap(NULL, m->size, m->write ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, m->fd, 0);
+        if (data == MAP_FAILED) return false;
+        m->data = (char *)data;
+        return true;
+    #endif
+    }
+
+    // Unmaps the view, keeping the file open
+    void unmap_view(FileMapping * m) {
+    #ifdef _WIN32
+        if (m->data) UnmapViewOfFile(m->data);
+        if (m->map) CloseHandle(m->map);
+        m->map = NULL;
+    #else
+        if (m->data) munmap(m->data, m->size);
+    #endif
+        m->data = NULL;
+    }
+
+    // Sets the size of the open file. Returns false on error.
+    bool set_file_size(FileMapping * m, size_t size) {
+    #ifdef _WIN32
+        LARGE_INTEGER pos;
+        pos.QuadPart = (LONGLONG)size;
+        return SetFilePointerEx(m->file, pos, NULL, FILE_BEGIN) && SetEndOfFile(m->file);
+    #else
+        return ftruncate(m->fd, (off_t)size) == 0;
+    #endif
+    }
+}
+
+FileMapping * map_file(const std::string & path, MapMode mode, size_t size) {
+    FileMapping * m = new FileMapping();
+    m->write = mode != MAP_READ;
+    m->data = NULL;
+
+#ifdef _WIN32
+    m->map = NULL;
+    m->file = CreateFileA(path.c_str(), m->write ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+        mode == MAP_CREATE ? CREATE_ALWAYS : mode == MAP_UPDATE ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m->file == INVALID_HANDLE_VALUE) { unmap_file(m); return NULL; }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(m->file, &file_size)) { unmap_file(m); return NULL; }
+    m->size = (size_t)file_size.QuadPart;
+#else
+    m->fd = open(path.c_str(), mode == MAP_CREATE ? O_RDWR | O_CREAT | O_TRUNC : mode == MAP_UPDATE ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    if (m->fd < 0) { unmap_file(m); return NULL; }
+
+    struct stat st;
+    if (fstat(m->fd, &st) != 0) { unmap_file(m); return NULL; }
+    m->size = (size_t)st.st_size;
+#endif
+
+    if (m->write && m->size < size) {
+        if (!set_file_size(m, size)) { unmap_file(m); return NULL; }
+        m->size = size;
+    }
+
+    // an empty file can not be mapped
+    if (m->size == 0 || !map_view(m)) { unmap_file(m); return NULL; }
+
+    return m;
+}
+
+void unmap_file(FileMapping * m) {
+    if (!m) return;
+    unmap_view(m);
+#ifdef _WIN32
+    if (m->file != INVALID_HANDLE_VALUE) CloseHandle(m->file);
+#else
+    if (m->fd >= 0) close(m->fd);
+#endif
+    delete m;
+}
+
+bool resize_mapping(FileMapping * m, size_t size) {
+    if (!m->write || size == 0) return false;
+    if (size == m->size) return true;
+
+    unmap_view(m);
+
+    bool resized = set_file_size(m, size);
+    if (resized) m->size = size;
+
+    return map_view(m) && resized;
+}
+
+bool sync_mapping(FileMapping * m) {
+#ifdef _WIN32
+    return FlushViewOfFile(m->data, 0) && FlushFileBuffers(m->file);
+#else
+    return msync(m->data, m->size, MS_SYNC) == 0;
+#endif
+}
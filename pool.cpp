@@ -0,0 +1,98 @@
+#include "stdafx.h"
+#include "pool.h"
+
+// *** Implementation of WorkerPool ***
+
+WorkerPool::WorkerPool(int threads) : barrier_count(0), barrier_generation(0) {
+    num_threads = std::max(threads, 1);
+
+    workers.reserve(num_threads - 1);
+    for (int i = 1; i < num_threads; ++i) {
+        workers.emplace_back(&WorkerPool::worker_loop, this, i);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::unique_lock<std::mutex> lck(mtx);
+        stopping = true;
+    }
+    job_cv.notify_all();
+
+    for (auto & th : workers) {
+        if (th.joinable()) th.join();
+    }
+}
+
+void WorkerPool::run(const std::function<void(int, int)> & fn) {
+    std::unique_lock<std::mutex> run_lck(run_mtx);
+
+    {
+        std::unique_lock<std::mutex> lck(mtx);
+        job = &fn;
+        running = num_threads - 1;
+        ++job_id;
+    }
+    job_cv.notify_all();
+
+    // the calling thread is worker 0
+    fn(0, num_threads);
+
+    std::unique_lock<std::mutex> lck(mtx);
+    while (running > 0) done_cv.wait(lck);
+    job = NULL;
+}
+
+void WorkerPool::sync() {
+    if (num_threads == 1) return;
+
+    unsigned gen = barrier_generation.load(std::memory_order_acquire);
+
+    if (barrier_count.fetch_add(1, std::memory_order_acq_rel) == num_threads - 1) {
+        // last thread to arrive releases everyone else
+        barrier_count.store(0, std::memory_order_relaxed);
+        barrier_generation.fetch_add(1, std::memory_order_release);
+    }
+    else {
+        // spin for a short while (barriers are usually very short), then start yielding
+        int spins = 0;
+        while (barrier_generation.load(std::memory_order_acquire) == gen) {
+            if (++spins > 1024) std::this_thread::yield();
+        }
+    }
+}
+
+void WorkerPool::worker_loop(int index) {
+    unsigned long long last_job = 0;
+
+    while (true) {
+        const std::function<void(int, int)> * fn;
+
+        {
+            std::unique_lock<std::mutex> lck(mtx);
+            while (!stopping && job_id == last_job) job_cv.wait(lck);
+            if (stopping) return;
+
+            last_job = job_id;
+            fn = job;
+        }
+
+        (*fn)(index, num_threads);
+
+        std::unique_lock<std::mutex> lck(mtx);
+        if (--running == 0) done_cv.notify_all();
+    }
+}
+
+WorkerPool & worker_pool(int threads, int slot) {
+    static std::mutex pools_mtx;
+    static std::map<std::pair<int, int>, WorkerPool *> pools;
+
+    threads = std::max(threads, 1);
+
+    std::unique_lock<std::mutex> lck(pools_mtx);
+    WorkerPool *& pool = pools[std::make_pair(threads, slot)];
+    if (pool == NULL) pool = new WorkerPool(threads);
+
+    return *pool;
+}
@@ -0,0 +1,213 @@
+#include "stdafx.h"
+#include "server.h"
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// hide from linkage
+namespace {
+#ifndef _WIN32
+    // Reads exactly 'size' bytes. Returns false on error or if the connection closes first.
+    bool read_full(int fd, char * data, size_t size) {
+        while (size > 0) {
+            ssize_t got = recv(fd, data, size, 0);
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) return false;
+            data += got;
+            size -= (size_t)got;
+        }
+        return true;
+    }
+
+    // Writes exactly 'size' bytes. Returns false on error.
+    bool write_full(int fd, const char * data, size_t size) {
+        while (size > 0) {
+            ssize_t sent = send(fd, data, size, 0);
+            if (sent < 0 && errno == EINTR) continue;
+            if (sent <= 0) return false;
+            data += sent;
+            size -= (size_t)sent;
+        }
+        return true;
+    }
+
+    // Reads one length-prefixed message. Returns false on error, at the end of the connection or if it is too long.
+    bool read_message(int fd, std::string & message) {
+        unsigned char prefix[4];
+        if (!read_full(fd, (char *)prefix, 4)) return false;
+
+        unsigned size = (unsigned)prefix[0] << 24 | (unsigned)prefix[1] << 16 | (unsigned)prefix[2] << 8 | prefix[3];
+        if (size > SocketServer::MAX_MESSAGE) return false;
+
+        message.resize(size);
+        return size == 0 || read_full(fd, &message[0], size);
+    }
+
+    // Writes one length-prefixed message. Returns false on error.
+    bool write_message(int fd, const std::string & message) {
+        if (message.size() > SocketServer::MAX_MESSAGE) return false;
+
+        unsigned size = (unsigned)message.size();
+        unsigned char prefix[4] = { (unsigned char)(size >> 24), (unsigned char)(size >> 16),
+            (unsigned char)(size >> 8), (unsigned char)size };
+
+        return write_full(fd, (const char *)prefix, 4) && write_full(fd, message.data(), message.size());
+    }
+
+    /* Fills in the address of the socket at 'path'. Returns false if the path is too long
+       for a socket address. */
+    bool socket_address(const std::string & path, sockaddr_un & addr) {
+        memset(&addr, 0, sizeof addr);
+        addr.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof addr.sun_path) return false;
+
+        memcpy(addr.sun_path, path.c_str(), path.size());
+        return true;
+    }
+
+    // Connects to the socket at 'path'. Returns the socket, or -1 on error.
+    int connect_to(const std::string & path) {
+        sockaddr_un addr;
+        if (!socket_address(path, addr)) return -1;
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+
+        if (connect(fd, (sockaddr *)&addr, sizeof addr) != 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+#endif
+}
+
+// *** Implementation of SocketServer class ***
+
+SocketServer::SocketServer(const std::string & path, const Handler & handler)
+    : path(path), handler(handler), listen_fd(-1) {
+#ifdef _WIN32
+    error_msg = "Unix domain sockets are not supported on Windows";
+#else
+    sockaddr_un addr;
+    if (!socket_address(path, addr)) {
+        error_msg = "the socket path is too long";
+        return;
+    }
+
+    // the socket file of a server that is still running must not be taken over
+    int other = connect_to(path);
+    if (other >= 0) {
+        close(other);
+        error_msg = "another server is listening there";
+        return;
+    }
+    unlink(path.c_str());
+
+    // clients that disconnect while a reply is being written must not end the server
+    signal(SIGPIPE, SIG_IGN);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0 || bind(listen_fd, (sockaddr *)&addr, sizeof addr) != 0 || listen(listen_fd, SOMAXCONN) != 0) {
+        error_msg = strerror(errno);
+        if (listen_fd >= 0) close(listen_fd);
+        listen_fd = -1;
+    }
+#endif
+}
+
+SocketServer::~SocketServer() {
+#ifndef _WIN32
+    if (listen_fd < 0) return;
+
+    close(listen_fd);
+    unlink(path.c_str());
+
+    // wake up the threads waiting for a request; a reply being computed is still sent
+    {
+        std::lock_guard<std::mutex> lck(mtx);
+        for (auto & client : clients) shutdown(client.first, SHUT_RD);
+    }
+
+    for (auto & client : clients) {
+        client.second.join();
+        close(client.first);
+    }
+#endif
+}
+
+void SocketServer::run(volatile int * stop) {
+#ifndef _WIN32
+    if (listen_fd < 0) return;
+
+    while (!*stop) {
+        reap_clients();
+
+        pollfd pfd = { listen_fd, POLLIN, 0 };
+        if (poll(&pfd, 1, 200) <= 0) continue;
+
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) continue;
+
+        std::lock_guard<std::mutex> lck(mtx);
+        clients[fd] = std::thread(&SocketServer::serve_client, this, fd);
+    }
+#endif
+}
+
+void SocketServer::serve_client(int fd) {
+#ifndef _WIN32
+    std::string request;
+    while (read_message(fd, request)) {
+        if (!write_message(fd, handler(request))) break;
+    }
+
+    // the socket is closed once the thread is joined, so that its number is not reused while still in 'clients'
+    std::lock_guard<std::mutex> lck(mtx);
+    finished.push_back(fd);
+#endif
+}
+
+void SocketServer::reap_clients() {
+#ifndef _WIN32
+    std::vector<std::pair<int, std::thread> > done;
+    {
+        std::lock_guard<std::mutex> lck(mtx);
+        for (int fd : finished) {
+            done.push_back(std::make_pair(fd, std::move(clients[fd])));
+            clients.erase(fd);
+        }
+        finished.clear();
+    }
+
+    for (auto & client : done) {
+        client.second.join();
+        close(client.first);
+    }
+#endif
+}
+
+bool send_request(const std::string & path, const std::string & request, std::string & reply, std::string * error) {
+#ifdef _WIN32
+    if (error) *error = "Unix domain sockets are not supported on Windows";
+    return false;
+#else
+    int fd = connect_to(path);
+    if (fd < 0) {
+        if (error) *error = "no server is listening at '" + path + "'";
+        return false;
+    }
+
+    bool done = write_message(fd, request) && read_message(fd, reply);
+    close(fd);
+
+    if (!done && error) *error = "the connection to the server was lost";
+    return done;
+#endif
+}
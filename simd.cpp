@@ -0,0 +1,204 @@
+#include "stdafx.h"
+#include "simd.h"
+
+// vector kernels are compiled for specific targets and only selected if the CPU supports them
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    #define BACON_X86_SIMD
+    #include <immintrin.h>
+#endif
+
+/* The gather-lanes kernels promise results identical to gather_lanes_scalar, so the compiler must not fuse
+   their multiplies and adds (it would with AVX-512, which implies FMA); the gather-dot kernels use FMA explicitly */
+#if defined(__clang__)
+    #pragma clang fp contract(off)
+#elif defined(__GNUC__)
+    #pragma GCC optimize("fp-contract=off")
+#endif
+
+double gather_dot_scalar(const double * weight, const unsigned short * index, const double * values, int count) {
+    double sum = 0.0;
+    for (int j = 0; j < count; ++j) sum += weight[j] * values[index[j]];
+    return sum;
+}
+
+void gather_lanes_scalar(const double * weight, const unsigned short * index, const double * values,
+                         int stride, int groups, int count, double * out) {
+    const int width = groups * GATHER_LANES;
+    double acc[GATHER_GROUPS * GATHER_LANES] = {};
+
+    for (int j = 0; j < count; ++j) {
+        const double * val = values + index[j] * stride;
+        for (int l = 0; l < width; ++l) acc[l] += weight[j] * val[l];
+    }
+
+    for (int l = 0; l < width; ++l) out[l] = acc[l];
+}
+
+// hide from linkage
+namespace {
+#ifdef BACON_X86_SIMD
+    // 4 lanes at a time using AVX2 gathers and FMA
+    __attribute__((target("avx2,fma")))
+    double gather_dot_avx2(const double * weight, const unsigned short * index, const double * values, int count) {
+        __m256d acc = _mm256_setzero_pd();
+        __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+
+        int j = 0;
+        for (; j + 4 <= count; j += 4) {
+            // masked gathers, so that no lane starts out undefined
+            __m128i idx = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *)(index + j)));
+            __m256d val = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), values, idx, all, 8);
+            acc = _mm256_fmadd_pd(_mm256_loadu_pd(weight + j), val, acc);
+        }
+
+        __m128d half = _mm_add_pd(_mm256_castpd256_pd128(acc), _mm256_extractf128_pd(acc, 1));
+        double sum = _mm_cvtsd_f64(half) + _mm_cvtsd_f64(_mm_unpackhi_pd(half, half));
+
+        for (; j < count; ++j) sum += weight[j] * values[index[j]];
+        return sum;
+    }
+
+    // 8 lanes at a time using AVX-512 gathers and FMA
+    __attribute__((target("avx512f")))
+    double gather_dot_avx512(const double * weight, const unsigned short * index, const double * values, int count) {
+        __m512d acc = _mm512_setzero_pd();
+
+        int j = 0;
+        for (; j + 8 <= count; j += 8) {
+            __m256i idx = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(index + j)));
+            __m512d val = _mm512_mask_i32gather_pd(_mm512_setzero_pd(), (__mmask8)0xFF, idx, values, 8);
+            acc = _mm512_fmadd_pd(_mm512_loadu_pd(weight + j), val, acc);
+        }
+
+        // the sum in the order of _mm512_reduce_add_pd, without its undefined upper halves
+        __m256d zero = _mm256_setzero_pd();
+        __m256d quad = _mm256_add_pd(_mm512_mask_extractf64x4_pd(zero, 0xF, acc, 0), _mm512_mask_extractf64x4_pd(zero, 0xF, acc, 1));
+        __m128d half = _mm_add_pd(_mm256_castpd256_pd128(quad), _mm256_extractf128_pd(quad, 1));
+        double sum = _mm_cvtsd_f64(half) + _mm_cvtsd_f64(_mm_unpackhi_pd(half, half));
+
+        for (; j < count; ++j) sum += weight[j] * values[index[j]];
+        return sum;
+    }
+
+    static_assert(GATHER_LANES == 8, "vector gather-lanes kernels assume 8 lanes (one AVX-512 or two AVX2 registers)");
+
+    /* Gather-lanes kernels: the lanes of an entry are contiguous, so each outcome takes one broadcast
+       and full-width loads. No FMA, so that each lane matches gather_lanes_scalar exactly.
+       G is the number of groups, fixed at compile time to keep the accumulators in registers. */
+    template<int G>
+    __attribute__((target("avx2")))
+    void gather_lanes_avx2_impl(const double * weight, const unsigned short * index, const double * values,
+                                int stride, int count, double * out) {
+        __m256d acc[2 * G];
+        for (int g = 0; g < 2 * G; ++g) acc[g] = _mm256_setzero_pd();
+
+        for (int j = 0; j < count; ++j) {
+            const double * val = values + index[j] * stride;
+            __m256d w = _mm256_set1_pd(weight[j]);
+            for (int g = 0; g < 2 * G; ++g) {
+                acc[g] = _mm256_add_pd(acc[g], _mm256_mul_pd(w, _mm256_loadu_pd(val + 4 * g)));
+            }
+        }
+
+        for (int g = 0; g < 2 * G; ++g) _mm256_storeu_pd(out + 4 * g, acc[g]);
+    }
+
+    __attribute__((target("avx2")))
+    void gather_lanes_avx2(const double * weight, const unsigned short * index, const double * values,
+                           int stride, int groups, int count, double * out) {
+        if (groups == 1) gather_lanes_avx2_impl<1>(weight, index, values, stride, count, out);
+        else if (groups == GATHER_GROUPS) gather_lanes_avx2_impl<GATHER_GROUPS>(weight, index, values, stride, count, out);
+        else gather_lanes_scalar(weight, index, values, stride, groups, count, out);
+    }
+
+    template<int G>
+    __attribute__((target("avx512f")))
+    void gather_lanes_avx512_impl(const double * weight, const unsigned short * index, const double * values,
+                                  int stride, int count, double * out) {
+        __m512d acc[G];
+        for (int g = 0; g < G; ++g) acc[g] = _mm512_setzero_pd();
+
+        for (int j = 0; j < count; ++j) {
+            const double * val = values + index[j] * stride;
+            __m512d w = _mm512_set1_pd(weight[j]);
+            for (int g = 0; g < G; ++g) {
+                acc[g] = _mm512_add_pd(acc[g], _mm512_mul_pd(w, _mm512_loadu_pd(val + GATHER_LANES * g)));
+            }
+        }
+
+        for (int g = 0; g < G; ++g) _mm512_storeu_pd(out + GATHER_LANES * g, acc[g]);
+    }
+
+    __attribute__((target("avx512f")))
+    void gather_lanes_avx512(const double * weight, const unsigned short * index, const double * values,
+                             int stride, int groups, int count, double * out) {
+        if (groups == 1) gather_lanes_avx512_impl<1>(weight, index, values, stride, count, out);
+        else if (groups == GATHER_GROUPS) gather_lanes_avx512_impl<GATHER_GROUPS>(weight, index, values, stride, count, out);
+        else gather_lanes_scalar(weight, index, values, stride, groups, count, out);
+    }
+#endif
+
+    // selected kernels and their name
+    GatherDotKernel selected_kernel = NULL;
+    GatherLanesKernel selected_lanes_kernel = NULL;
+    const char * selected_name = "scalar";
+
+    void select_kernel() {
+        const char * forced = std::getenv("BACON_SIMD");
+        std::string want = forced ? forced : "";
+
+        selected_kernel = gather_dot_scalar;
+        selected_lanes_kernel = gather_lanes_scalar;
+        selected_name = "scalar";
+
+        bool avx2 = false, avx512 = false;
+    #ifdef BACON_X86_SIMD
+        __builtin_cpu_init();
+
+        avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        avx512 = __builtin_cpu_supports("avx512f");
+    #endif
+
+        // a choice that can not be honoured is reported (on stderr, to keep it out of results), then ignored
+        if (want != "" && want != "scalar" && want != "avx2" && want != "avx512") {
+            std::cerr << "Warning: unknown BACON_SIMD value '" << want <<
+                "' (choices: scalar, avx2, avx512). Using the fastest instructions supported." << std::endl;
+            want = "";
+        }
+        else if ((want == "avx2" && !avx2) || (want == "avx512" && !avx512)) {
+            std::cerr << "Warning: BACON_SIMD=" << want << " is not supported by this CPU or build. " <<
+                "Using the fastest instructions supported." << std::endl;
+            want = "";
+        }
+
+    #ifdef BACON_X86_SIMD
+        if (avx512 && (want == "" || want == "avx512")) {
+            selected_kernel = gather_dot_avx512;
+            selected_lanes_kernel = gather_lanes_avx512;
+            selected_name = "avx512";
+        }
+        else if (avx2 && (want == "" || want == "avx2")) {
+            selected_kernel = gather_dot_avx2;
+            selected_lanes_kernel = gather_lanes_avx2;
+            selected_name = "avx2";
+        }
+    #endif
+    }
+
+    std::once_flag select_flag;
+}
+
+GatherDotKernel gather_dot_kernel() {
+    std::call_once(select_flag, select_kernel);
+    return selected_kernel;
+}
+
+GatherLanesKernel gather_lanes_kernel() {
+    std::call_once(select_flag, select_kernel);
+    return selected_lanes_kernel;
+}
+
+const char * simd_name() {
+    std::call_once(select_flag, select_kernel);
+    return selected_name;
+}
@@ -0,0 +1,319 @@
+#include "stdafx.h"
+#include "store.h"
+#include "mapping.h"
+#include "lockfile.h"
+
+// hide from linkage
+namespace {
+    // identifies a strategy store (and its byte order)
+    const unsigned long long STORE_MAGIC = 0x315254534e434142ULL; // "BACNSTR1"
+
+    // version of the strategy store format
+    const unsigned STORE_VERSION = 1;
+
+    // number of entries in the index of a new store
+    const unsigned STORE_INITIAL_CAPACITY = 256;
+
+    // least number of slots added when the file grows
+    const unsigned STORE_MIN_GROWTH = 16;
+
+    // what an index entry is used by
+    enum EntryKind { ENTRY_FREE = 0, ENTRY_STRATEGY = 1, ENTRY_DERIVED = 2 };
+}
+
+struct StrategyStore::Header {
+    unsigned long long magic;
+    unsigned version, goal, slot_size, capacity, slots;
+
+    // incremented by every change, so that other processes know to read the index again (0 in older files)
+    unsigned generation;
+    unsigned reserved[8];
+};
+
+struct StrategyStore::Entry {
+    char name[MAX_NAME + 1];
+    unsigned slot, used;
+};
+
+// *** Implementation of StrategyStore class ***
+
+StrategyStore::StrategyStore(const std::string & path)
+    : path(path), mapping(NULL), slot_size((GOAL * GOAL + 63) / 64 * 64), generation(0) {
+    static_assert(sizeof(Header) == 64, "strategy store header must be 64 bytes");
+    static_assert(sizeof(Entry) == 128, "strategy store index entries must be 128 bytes");
+
+    // another process must not be creating or changing the store meanwhile
+    LockedFile lock(path);
+    if (!lock.ok()) return;
+
+    if (lock.size() > 0) {
+        mapping = map_file(path, MAP_UPDATE);
+        if (!mapping) return;
+
+        const Header & h = header();
+        bool valid = mapping->size >= sizeof(Header) && h.magic == STORE_MAGIC && h.version == STORE_VERSION &&
+            h.goal == (unsigned)GOAL && h.slot_size == slot_size && h.capacity > 0 &&
+            h.slots >= index_slots(h.capacity) && (size_t)h.slots * slot_size <= mapping->size;
+
+        if (!valid) {
+            unmap_file(mapping);
+            mapping = NULL;
+            return;
+        }
+    }
+    else {
+        mapping = map_file(path, MAP_UPDATE, index_slots(STORE_INITIAL_CAPACITY) * slot_size);
+        if (!mapping) return;
+
+        Header & h = header();
+        h.magic = STORE_MAGIC;
+        h.version = STORE_VERSION;
+        h.goal = GOAL;
+        h.slot_size = (unsigned)slot_size;
+        h.capacity = STORE_INITIAL_CAPACITY;
+        h.slots = (unsigned)index_slots(STORE_INITIAL_CAPACITY);
+        h.generation = 0;
+    }
+
+    generation = header().generation;
+    read_index();
+}
+
+void StrategyStore::read_index() {
+    index.clear();
+    derived.clear();
+    free_entries.clear();
+    free_slots.clear();
+
+    const Header & h = header();
+    std::vector<char> taken(h.slots, 0);
+
+    for (unsigned e = h.capacity; e-- > 0;) {
+        Entry & en = entry(e);
+        std::map<std::string, unsigned> & names = en.used == ENTRY_DERIVED ? derived : index;
+        bool used = (en.used == ENTRY_STRATEGY || en.used == ENTRY_DERIVED) &&
+            en.slot >= index_slots(h.capacity) && en.slot < h.slots && !taken[en.slot] &&
+            memchr(en.name, '\0', sizeof en.name) != NULL && en.name[0] != '\0' && !names.count(en.name);
+
+        if (used) {
+            taken[en.slot] = 1;
+            names[en.name] = e;
+        }
+        else {
+            en.used = ENTRY_FREE;
+            free_entries.push_back(e);
+        }
+    }
+
+    for (unsigned s = h.slots; s-- > index_slots(h.capacity);) {
+        if (!taken[s]) free_slots.push_back(s);
+    }
+}
+
+bool StrategyStore::refresh() {
+    if (!mapping) return false;
+    if (header().generation == generation) return true;
+
+    // map the slots added since (the header, in the first slot, is always mapped)
+    size_t size = (size_t)header().slots * slot_size;
+    if (size > mapping->size && !resize_mapping(mapping, size)) {
+        if (!mapping->data) {
+            unmap_file(mapping);
+            mapping = NULL;
+        }
+        return false;
+    }
+
+    generation = header().generation;
+    read_index();
+    return true;
+}
+
+void StrategyStore::changed() {
+    generation = ++header().generation;
+}
+
+StrategyStore::~StrategyStore() {
+    if (!mapping) return;
+    sync_mapping(mapping);
+    unmap_file(mapping);
+}
+
+StrategyStore::Header & StrategyStore::header() const {
+    return *(Header *)mapping->data;
+}
+
+StrategyStore::Entry & StrategyStore::entry(size_t e) const {
+    return ((Entry *)(mapping->data + sizeof(Header)))[e];
+}
+
+unsigned char * StrategyStore::slot(size_t s) const {
+    return (unsigned char *)mapping->data + s * slot_size;
+}
+
+size_t StrategyStore::index_slots(size_t capacity) const {
+    return (sizeof(Header) + capacity * sizeof(Entry) + slot_size - 1) / slot_size;
+}
+
+std::vector<std::string> StrategyStore::names() const {
+    std::vector<std::string> result;
+    result.reserve(index.size());
+    for (auto & name : index) result.push_back(name.first);
+    return result;
+}
+
+MatrixStrategy * StrategyStore::load(const std::string & name) {
+    return load(index, name);
+}
+
+MatrixStrategy * StrategyStore::load_derived(const std::string & key) {
+    return load(derived, key);
+}
+
+MatrixStrategy * StrategyStore::load(const std::map<std::string, unsigned> & names, const std::string & name) {
+    // another process may have freed the slot and reused it since the index was read
+    LockedFile lock(path);
+    if (!lock.ok() || !refresh()) return NULL;
+
+    auto it = names.find(name);
+    if (it == names.end()) return NULL;
+
+    return new MatrixStrategy(slot(entry(it->second).slot), name);
+}
+
+unsigned StrategyStore::take_slot() {
+    if (free_slots.empty()) {
+        // grow by half, so that adding strategies one at a time remaps the file only a logarithmic number of times
+        unsigned slots = header().slots, added = std::max(slots / 2, STORE_MIN_GROWTH);
+        if (!resize_mapping(mapping, (size_t)(slots + added) * slot_size)) return 0;
+
+        header().slots = slots + added;
+        changed();
+        for (unsigned s = slots + added; s-- > slots;) free_slots.push_back(s);
+    }
+
+    unsigned s = free_slots.back();
+    free_slots.pop_back();
+    return s;
+}
+
+bool StrategyStore::grow_index() {
+    unsigned capacity = header().capacity, new_capacity = capacity * 2;
+    unsigned first_slot = (unsigned)index_slots(new_capacity);
+    changed();
+
+    // the slots the index is taking over can no longer be handed out
+    free_slots.erase(std::remove_if(free_slots.begin(), free_slots.end(),
+        [first_slot](unsigned s) { return s < first_slot; }), free_slots.end());
+
+    if (header().slots < first_slot) {
+        if (!resize_mapping(mapping, (size_t)first_slot * slot_size)) return false;
+        header().slots = first_slot;
+    }
+
+    // move the strategies out of those slots (free slots are all past them, and so are new ones)
+    for (auto * names : { &index, &derived }) {
+        for (auto & name : *names) {
+            unsigned from = entry(name.second).slot;
+            if (from >= first_slot) continue;
+
+            unsigned to = take_slot();
+            if (!to) return false;
+
+            memcpy(slot(to), slot(from), GOAL * GOAL);
+            entry(name.second).slot = to;
+        }
+    }
+
+    memset(&entry(capacity), 0, (size_t)(new_capacity - capacity) * sizeof(Entry));
+    header().capacity = new_capacity;
+
+    for (unsigned e = new_capacity; e-- > capacity;) free_entries.push_back(e);
+    return true;
+}
+
+bool StrategyStore::put(const std::string & name, MatrixStrategy & strat) {
+    return put(index, ENTRY_STRATEGY, name, strat);
+}
+
+bool StrategyStore::put_derived(const std::string & key, MatrixStrategy & strat) {
+    return put(derived, ENTRY_DERIVED, key, strat);
+}
+
+bool StrategyStore::put(std::map<std::string, unsigned> & names, unsigned kind, const std::string & name, MatrixStrategy & strat) {
+    if (!mapping || name.empty() || name.size() > MAX_NAME) return false;
+
+    LockedFile lock(path);
+    if (!lock.ok() || !refresh()) return false;
+
+    auto it = names.find(name);
+    if (it == names.end() && free_entries.empty() && !grow_index()) return false;
+
+    unsigned s = take_slot();
+    if (!s) return false;
+    memcpy(slot(s), strat.cells(), GOAL * GOAL);
+
+    if (it != names.end()) {
+        // switch the entry over to the new copy only once it is complete
+        Entry & en = entry(it->second);
+        free_slots.push_back(en.slot);
+        en.slot = s;
+        changed();
+        return true;
+    }
+
+    unsigned e = free_entries.back();
+    free_entries.pop_back();
+
+    Entry & en = entry(e);
+    memset(en.name, 0, sizeof en.name);
+    memcpy(en.name, name.c_str(), name.size());
+    en.slot = s;
+    en.used = kind;
+
+    names[name] = e;
+    changed();
+    return true;
+}
+
+bool StrategyStore::remove(const std::string & name) {
+    LockedFile lock(path);
+    if (!lock.ok() || !refresh()) return false;
+
+    auto it = index.find(name);
+    if (it == index.end()) return false;
+
+    Entry & en = entry(it->second);
+    en.used = ENTRY_FREE;
+    free_slots.push_back(en.slot);
+    free_entries.push_back(it->second);
+
+    index.erase(it);
+    changed();
+    return true;
+}
+
+void StrategyStore::clear() {
+    LockedFile lock(path);
+    if (!lock.ok() || !refresh()) return;
+
+    for (auto * names : { &index, &derived }) {
+        for (auto & name : *names) {
+            entry(name.second).used = ENTRY_FREE;
+            free_entries.push_back(name.second);
+        }
+        names->clear();
+    }
+
+    /* every slot past the index is free now. The file keeps its size: other processes may have it mapped,
+       and cutting it short under them would crash them on their next access. */
+    unsigned first_slot = (unsigned)index_slots(header().capacity);
+    free_slots.clear();
+    for (unsigned s = header().slots; s-- > first_slot;) free_slots.push_back(s);
+
+    changed();
+}
+
+bool StrategyStore::commit() {
+    return mapping && sync_mapping(mapping);
+}
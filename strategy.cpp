@@ -45,51 +45,146 @@ int HumanStrategy::operator() (int _, int __) {
 
 // MatrixStrategy
 
+static_assert(MAX_ROLLS <= 255, "roll numbers must fit in the bytes of a MatrixStrategy");
+
+// hide from linkage
+namespace {
+    // Clamps a roll number to 0 .. MAX_ROLLS (a plain cast to a byte would wrap -1 around to 255)
+    unsigned char clamp_roll(int roll) {
+        return (unsigned char)std::min(std::max(roll, 0), MAX_ROLLS);
+    }
+
+    // Warns that 'count' roll numbers given to the strategy 'name', the first 'roll' at (score0, score1), were clamped
+    void warn_clamped(const std::string & name, int count, int roll, int score0, int score1) {
+        std::cerr << "Warning: " << count << " roll number(s) of strategy '" << name << "' out of range (0 to " <<
+            MAX_ROLLS << ") were clamped, the first " << roll << " at score (" << score0 << ", " << score1 << ")." << std::endl;
+    }
+}
+
 MatrixStrategy::MatrixStrategy(IStrategy & strat, const std::string & name) : name(name) {
+    int bad = 0, first_i = 0, first_j = 0, first_roll = 0;
+
     for (int i = 0; i < GOAL; ++i) {
         for (int j = 0; j < GOAL; ++j) {
-            rolls[i][j] = strat(i, j);
+            int roll = strat(i, j);
+            rolls[i][j] = clamp_roll(roll);
+
+            if (rolls[i][j] != roll && bad++ == 0) {
+                first_i = i; first_j = j; first_roll = roll;
+            }
         }
     }
+
+    if (bad) warn_clamped(name, bad, first_roll, first_i, first_j);
 }
 
 MatrixStrategy::MatrixStrategy(int ** mat, const std::string & name) : name(name) {
+    int bad = 0, first_i = 0, first_j = 0, first_roll = 0;
+
     for (int i = 0; i < GOAL; ++i) {
         for (int j = 0; j < GOAL; ++j) {
-            rolls[i][j] = mat[i][j];
+            rolls[i][j] = clamp_roll(mat[i][j]);
+
+            if (rolls[i][j] != mat[i][j] && bad++ == 0) {
+                first_i = i; first_j = j; first_roll = mat[i][j];
+            }
         }
     }
+
+    if (bad) warn_clamped(name, bad, first_roll, first_i, first_j);
 }
 
-void MatrixStrategy::set_roll_num(int score0, int score1, int roll) {
-    rolls[score0][score1] = roll;
+bool MatrixStrategy::set_roll_num(int score0, int score1, int roll) {
+    rolls[score0][score1] = clamp_roll(roll);
+    if (rolls[score0][score1] == roll) return true;
+
+    warn_clamped(name, 1, roll, score0, score1);
+    return false;
 }
 
 int MatrixStrategy::get_roll_num(int score0, int score1) {
     return rolls[score0][score1];
 }
 
-bool MatrixStrategy::load_from_file(std::string path) {
-    std::ifstream ifs(path);
-    if (!ifs) return false;
+bool MatrixStrategy::load_from_file(std::string path, std::string * error) {
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs) {
+        if (error) *error = "can not open the file";
+        return false;
+    }
+
+    // read the whole file at once, then parse it in place (much faster than extracting each number)
+    std::stringstream contents;
+    contents << ifs.rdbuf();
+    ifs.close();
+    const std::string text = contents.str();
+
+    const char * p = text.c_str(), * end = p + text.size();
+    while (p < end && isspace((unsigned char)*p)) ++p;
+
+    if (end - p < 8 || strncmp(p, "strategy", 8) != 0 || (end - p > 8 && !isspace((unsigned char)p[8]))) {
+        if (error) *error = "missing 'strategy' header";
+        return false;
+    }
+    p += 8;
+
+    // the rest of the header line is the name
+    const char * name_end = std::find(p, end, '\n');
+    std::string new_name(p, name_end);
+    p = name_end;
 
-    std::string header;
-    ifs >> header;
-    if (header != "strategy") return false; // wrong format
-    std::getline(ifs, name);
+    auto wsfront = std::find_if_not(new_name.begin(), new_name.end(),[](int c){return std::isspace(c);});
+    auto wsback = std::find_if_not(new_name.rbegin(), new_name.rend(),[](int c){return std::isspace(c);}).base();
+    new_name = (wsback <= wsfront ? std::string() : std::string(wsfront,wsback));
 
-    auto wsfront = std::find_if_not(name.begin(), name.end(),[](int c){return std::isspace(c);});
-    auto wsback = std::find_if_not(name.rbegin(), name.rend(),[](int c){return std::isspace(c);}).base();
-    name = (wsback <= wsfront ? std::string() : std::string(wsfront,wsback));
+    unsigned char new_rolls[GOAL][GOAL];
 
     for (int i = 0; i < GOAL; ++i) {
         for (int j = 0; j < GOAL; ++j) {
-            int tmp; ifs >> tmp;
-            set_roll_num(i, j, tmp);
+            while (p < end && isspace((unsigned char)*p)) ++p;
+
+            bool negative = p < end && *p == '-';
+            if (negative) ++p;
+
+            if (p == end || !isdigit((unsigned char)*p)) {
+                if (error) {
+                    std::stringstream msg;
+                    if (p == end) msg << "expected " << GOAL * GOAL << " roll numbers, found " << i * GOAL + j;
+                    else msg << "unexpected '" << *p << "' at score (" << i << ", " << j << ")";
+                    *error = msg.str();
+                }
+                return false;
+            }
+
+            int roll = 0;
+            while (p < end && isdigit((unsigned char)*p) && roll <= MAX_ROLLS) roll = roll * 10 + (*p++ - '0');
+
+            if (negative || roll > MAX_ROLLS) {
+                if (error) {
+                    std::stringstream msg;
+                    msg << "roll number at score (" << i << ", " << j << ") is out of range (0 to " << MAX_ROLLS << ")";
+                    *error = msg.str();
+                }
+                return false;
+            }
+
+            new_rolls[i][j] = (unsigned char)roll;
         }
     }
 
-    ifs.close();
+    // nothing but whitespace may follow the last roll number
+    while (p < end && isspace((unsigned char)*p)) ++p;
+    if (p != end) {
+        if (error) {
+            std::stringstream msg;
+            msg << "unexpected '" << *p << "' after the " << GOAL * GOAL << " roll numbers";
+            *error = msg.str();
+        }
+        return false;
+    }
+
+    name = new_name;
+    memcpy(rolls, new_rolls, sizeof rolls);
     return true;
 }
 
@@ -0,0 +1,159 @@
+#include "stdafx.h"
+#include "telemetry.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <unistd.h>
+#include <sys/resource.h>
+#endif
+
+// *** Implementation of TournamentTelemetry class ***
+
+TournamentTelemetry::TournamentTelemetry(const std::string & path, int threads, double interval)
+    : threads(std::max(threads, 1)), interval(interval > 0 ? interval : DEFAULT_INTERVAL),
+      counters(new Counters[std::max(threads, 1)]), phase("start"), phase_pairs(0), earlier_pairs(0), later_pairs(0),
+      stopping(false) {
+
+    for (int t = 0; t < this->threads; ++t) {
+        counters[t].pairs = 0;
+        counters[t].states = 0;
+    }
+    last_pairs.assign(this->threads, 0);
+    last_states.assign(this->threads, 0);
+
+    start = phase_start = last_time = std::chrono::steady_clock::now();
+
+    file = fopen(path.c_str(), "a");
+    if (file) writer = std::thread(&TournamentTelemetry::writer_loop, this);
+}
+
+TournamentTelemetry::~TournamentTelemetry() {
+    if (!file) return;
+
+    {
+        std::lock_guard<std::mutex> lck(mtx);
+        stopping = true;
+    }
+    stop_cv.notify_all();
+    writer.join();
+
+    write();
+    fclose(file);
+}
+
+void TournamentTelemetry::begin_phase(const std::string & name, long long pairs, long long later_pairs) {
+    std::lock_guard<std::mutex> lck(mtx);
+
+    // close the previous phase with a line of its own
+    if (file && phase_pairs) write_line();
+
+    for (int t = 0; t < threads; ++t) {
+        earlier_pairs += counters[t].pairs;
+        counters[t].pairs = 0;
+        counters[t].states = 0;
+    }
+    std::fill(last_pairs.begin(), last_pairs.end(), 0);
+    std::fill(last_states.begin(), last_states.end(), 0);
+
+    phase = name;
+    phase_pairs = pairs;
+    this->later_pairs = later_pairs;
+    phase_start = last_time = std::chrono::steady_clock::now();
+}
+
+void TournamentTelemetry::write() {
+    if (!file) return;
+
+    std::lock_guard<std::mutex> lck(mtx);
+    write_line();
+}
+
+void TournamentTelemetry::write_line() {
+    auto now = std::chrono::steady_clock::now();
+    double since_last = std::chrono::duration<double>(now - last_time).count();
+    double since_phase = std::chrono::duration<double>(now - phase_start).count();
+    double since_start = std::chrono::duration<double>(now - start).count();
+
+    std::stringstream threads_json;
+    long long pairs = 0, states = 0, new_pairs = 0, new_states = 0;
+
+    for (int t = 0; t < threads; ++t) {
+        long long p = counters[t].pairs.load(std::memory_order_relaxed);
+        long long s = counters[t].states.load(std::memory_order_relaxed);
+
+        double pair_rate = since_last > 0 ? (p - last_pairs[t]) / since_last : 0.0;
+        double state_rate = since_last > 0 ? (s - last_states[t]) / since_last : 0.0;
+
+        threads_json << (t ? "," : "") << "{\"id\":" << t << ",\"pairs\":" << p << ",\"pairs_per_sec\":" <<
+            std::fixed << std::setprecision(2) << pair_rate << ",\"states_per_sec\":" << std::setprecision(0) << state_rate << "}";
+
+        pairs += p;
+        states += s;
+        new_pairs += p - last_pairs[t];
+        new_states += s - last_states[t];
+        last_pairs[t] = p;
+        last_states[t] = s;
+    }
+
+    double avg_rate = since_phase > 0 ? pairs / since_phase : 0.0;
+
+    // time left at the average rate of the phase so far (-1 until there is one)
+    double eta = avg_rate > 0 ? std::max(phase_pairs - pairs, 0LL) / avg_rate : -1.0;
+
+    // the same for the whole run, at the average rate since it started
+    long long run_done = earlier_pairs + pairs, run_total = earlier_pairs + std::max(phase_pairs, pairs) + later_pairs;
+    double run_rate = since_start > 0 ? run_done / since_start : 0.0;
+    double run_eta = run_rate > 0 ? (run_total - run_done) / run_rate : -1.0;
+
+    fprintf(file, "{\"time\":%.1f,\"elapsed\":%.1f,\"phase\":\"%s\",\"pairs_done\":%lld,\"pairs_total\":%lld,"
+        "\"run_pairs_done\":%lld,\"run_pairs_total\":%lld,"
+        "\"pairs_per_sec\":%.2f,\"states_per_sec\":%.0f,\"avg_pairs_per_sec\":%.2f,\"memory_bytes\":%llu,"
+        "\"eta_sec\":%.1f,\"run_eta_sec\":%.1f,\"threads\":[%s]}\n",
+        std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count(),
+        since_start, phase.c_str(), pairs, phase_pairs, run_done, run_total,
+        since_last > 0 ? new_pairs / since_last : 0.0, since_last > 0 ? new_states / since_last : 0.0, avg_rate,
+        (unsigned long long)memory_in_use(), eta, run_eta, threads_json.str().c_str());
+    fflush(file);
+
+    last_time = now;
+}
+
+void TournamentTelemetry::writer_loop() {
+    std::unique_lock<std::mutex> lck(mtx);
+
+    while (!stopping) {
+        if (stop_cv.wait_for(lck, std::chrono::duration<double>(interval), [this] { return stopping; })) break;
+
+        lck.unlock();
+        write();
+        lck.lock();
+    }
+}
+
+size_t TournamentTelemetry::memory_in_use() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof pmc)) return pmc.WorkingSetSize;
+    return 0;
+#else
+    // current resident set size where /proc is available, else the peak
+    FILE * statm = fopen("/proc/self/statm", "r");
+    if (statm) {
+        unsigned long long pages_total = 0, pages_resident = 0;
+        int read = fscanf(statm, "%llu %llu", &pages_total, &pages_resident);
+        fclose(statm);
+        if (read == 2) return (size_t)(pages_resident * (unsigned long long)sysconf(_SC_PAGESIZE));
+    }
+
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    #ifdef __APPLE__
+    return (size_t)usage.ru_maxrss;
+    #else
+    return (size_t)usage.ru_maxrss * 1024;
+    #endif
+#endif
+}
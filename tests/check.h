@@ -0,0 +1,25 @@
+#pragma once
+
+#include "stdafx.h"
+
+#ifndef CHECK_H
+    #define CHECK_H
+
+    /* Minimal checks for the test programs in this directory (run with 'make test'): a failed check prints
+       where it failed, and check_result() makes the program exit with an error if any did */
+    static int check_failures = 0;
+
+    #define CHECK(cond) do { \
+            if (!(cond)) { \
+                ++check_failures; \
+                std::cout << __FILE__ << ":" << __LINE__ << ": check failed: " << #cond << std::endl; \
+            } \
+        } while (0)
+
+    // Prints whether the checks of test 'name' passed. Returns the exit code of the test program.
+    inline int check_result(const char * name) {
+        std::cout << name << ": " << (check_failures ? "FAILED" : "passed") << std::endl;
+        return check_failures ? 1 : 0;
+    }
+
+#endif
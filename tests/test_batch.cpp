@@ -0,0 +1,52 @@
+#include "stdafx.h"
+#include "analysis.h"
+#include "hog.h"
+#include "check.h"
+
+#include <random>
+
+// average_win_rates (one batched sweep per WIN_RATE_BATCH opponents) against average_win_rate (one sweep each)
+int main() {
+    std::mt19937 gen(7);
+
+    // random fixed strategies, some mostly alike so that lanes share outcomes
+    std::vector<MatrixStrategy> strats(WIN_RATE_BATCH + 3);
+    for (size_t k = 0; k < strats.size(); ++k) {
+        for (int i = 0; i < GOAL; ++i) {
+            for (int j = 0; j < GOAL; ++j) {
+                int rolls = k % 2 ? (int)(gen() % (MAX_ROLLS + 1)) : (i + j + (int)k) % 4 + 3;
+                strats[k].set_roll_num(i, j, gen() % 16 ? rolls : (int)(gen() % (MAX_ROLLS + 1)));
+            }
+        }
+    }
+
+    SwapStrategy swap_strat;
+    AlwaysRollStrategy always5(5);
+
+    for (int rules = 0; rules < 4; ++rules) {
+        enable_swine_swap = rules & 1;
+        enable_time_trot = rules >> 1 & 1;
+
+        // matrix strategies only (the specialized sweep), then with other strategies mixed in
+        for (int mixed = 0; mixed < 2; ++mixed) {
+            std::vector<IStrategy *> opponents;
+            for (size_t k = 1; k < strats.size(); ++k) opponents.push_back(&strats[k]);
+            if (mixed) {
+                opponents[1] = &swap_strat;
+                opponents[WIN_RATE_BATCH + 1] = &always5;
+            }
+
+            for (int plays_as = -1; plays_as <= 1; ++plays_as) {
+                std::vector<double> batched(opponents.size());
+                average_win_rates(strats[0], opponents, batched.data(), plays_as);
+
+                for (size_t k = 0; k < opponents.size(); ++k) {
+                    double single = average_win_rate(strats[0], *opponents[k], plays_as);
+                    CHECK(std::fabs(batched[k] - single) <= 1e-12);
+                }
+            }
+        }
+    }
+
+    return check_result("test_batch");
+}
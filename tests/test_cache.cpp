@@ -0,0 +1,111 @@
+#include "stdafx.h"
+#include "cache.h"
+#include "check.h"
+
+#include <fstream>
+
+// number of results recorded by the tests, few enough that none is pushed out of a full bucket
+const int RESULTS = 20;
+
+// Win rate recorded for the k-th pair of fingerprints (k + 1, k + 1000)
+double rate_of(int k) {
+    return 0.25 + k / 100.0;
+}
+
+// Number of the recorded results 'cache' finds, either way round
+int found(MatchupCache & cache) {
+    int count = 0;
+    for (int k = 0; k < RESULTS; ++k) {
+        double wr, flipped;
+        if (cache.lookup(k + 1, k + 1000, wr) && wr == rate_of(k) &&
+            cache.lookup(k + 1000, k + 1, flipped) && flipped == 1.0 - rate_of(k)) ++count;
+    }
+    return count;
+}
+
+// MatchupCache: saving and finding results, reopening, enlarging, and files that are not caches
+int main(int argc, char ** argv) {
+    std::string path = std::string(argc > 0 ? argv[0] : "test_cache") + ".dat";
+    std::remove(path.c_str());
+
+    {
+        MatchupCache cache(path, 256);
+        CHECK(found(cache) == 0);
+
+        for (int k = 0; k < RESULTS; ++k) cache.insert(k + 1, k + 1000, rate_of(k));
+
+        // only saved results are found
+        CHECK(found(cache) == 0);
+        CHECK(cache.save() == RESULTS && cache.save() == 0);
+        CHECK(found(cache) == RESULTS && cache.hits() == 2 * RESULTS);
+    }
+
+    // a full batch is written without save()
+    {
+        MatchupCache cache(path, 4096);
+        for (int k = 0; k < MatchupCache::SAVE_RESULTS; ++k) cache.insert(k + 5000, k + 6000, rate_of(0));
+
+        MatchupCache other(path, 4096);
+        double wr;
+        CHECK(other.lookup(5000, 6000, wr) && wr == rate_of(0) && cache.save() == 0);
+    }
+
+    // another cache of the same file finds them, as does one asking for more slots, which enlarges the file
+    {
+        MatchupCache cache(path, 256);
+        CHECK(found(cache) == RESULTS);
+    }
+    {
+        MatchupCache cache(path, 1024);
+        CHECK(found(cache) == RESULTS);
+    }
+    {
+        MatchupCache cache(path, 256);
+        CHECK(found(cache) == RESULTS);
+    }
+
+    // results recorded while another process enlarges the cache are placed by its new capacity
+    std::remove(path.c_str());
+    {
+        MatchupCache cache(path, 256);
+        for (int k = 0; k < RESULTS; ++k) cache.insert(k + 1, k + 1000, rate_of(k));
+
+        MatchupCache larger(path, 1024);
+        CHECK(cache.save() == RESULTS && found(cache) == RESULTS);
+    }
+    {
+        MatchupCache cache(path, 1024);
+        CHECK(found(cache) == RESULTS);
+    }
+
+    // a file that is not a cache is started over, and results recorded while it is being replaced are dropped
+    {
+        MatchupCache cache(path, 256);
+        cache.insert(1, 1000, rate_of(0));
+
+        std::ofstream garbage(path.c_str(), std::ios::binary | std::ios::trunc);
+        garbage << "not a matchup cache";
+        garbage.close();
+
+        CHECK(cache.save() == 0 && cache.save() == 0);
+    }
+    {
+        MatchupCache cache(path, 256);
+        CHECK(found(cache) == 0);
+
+        cache.insert(1, 1000, rate_of(0));
+        CHECK(cache.save() == 1);
+        double wr;
+        CHECK(cache.lookup(1, 1000, wr) && wr == rate_of(0));
+    }
+
+    // a cache that can not be opened finds nothing and saves nothing
+    {
+        MatchupCache cache(path + ".missing/cache.dat", 256);
+        cache.insert(1, 1000, rate_of(0));
+        CHECK(found(cache) == 0 && cache.save() == 0);
+    }
+
+    std::remove(path.c_str());
+    return check_result("test_cache");
+}
@@ -0,0 +1,164 @@
+#include "stdafx.h"
+#include "server.h"
+#include "check.h"
+
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// A request of the server: each argument followed by a '\0'
+std::string request(const std::vector<std::string> & args) {
+    std::string result;
+    for (auto & arg : args) result += arg + '\0';
+    return result;
+}
+
+// Connects to the socket at 'path' without going through send_request. Returns the socket, or -1.
+int raw_connect(const std::string & path) {
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.c_str(), path.size());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (sockaddr *)&addr, sizeof addr) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Sends a 4-byte big-endian length, then 'data'
+bool raw_send(int fd, unsigned size, const std::string & data) {
+    unsigned char prefix[4] = { (unsigned char)(size >> 24), (unsigned char)(size >> 16),
+        (unsigned char)(size >> 8), (unsigned char)size };
+    std::string message = std::string((const char *)prefix, 4) + data;
+    return send(fd, message.data(), message.size(), 0) == (ssize_t)message.size();
+}
+
+// Reads one reply. Returns false if the connection closes first.
+bool raw_receive(int fd, std::string & reply) {
+    unsigned char prefix[4];
+    if (recv(fd, prefix, 4, MSG_WAITALL) != 4) return false;
+
+    unsigned size = (unsigned)prefix[0] << 24 | (unsigned)prefix[1] << 16 | (unsigned)prefix[2] << 8 | prefix[3];
+    reply.resize(size);
+    return size == 0 || recv(fd, &reply[0], size, MSG_WAITALL) == (ssize_t)size;
+}
+
+/* The framing of SocketServer and send_request, the size limit, and the replies of 'bacon serve'
+   (if bin/bacon is built) to requests it refuses */
+int main(int argc, char ** argv) {
+    std::string base = std::string(argc > 0 ? argv[0] : "test_server");
+    std::string path = base + ".sock";
+
+    {
+        volatile int stop = 0;
+        SocketServer server(path, [](const std::string & req) { return "got " + std::to_string(req.size()) + ":" + req; });
+        CHECK(server.ok());
+        std::thread runner([&server, &stop]() { server.run(&stop); });
+
+        // another server can not take over the socket
+        SocketServer other(path, [](const std::string &) { return std::string(); });
+        CHECK(!other.ok() && !other.error().empty());
+
+        std::string reply, error;
+        CHECK(send_request(path, request({ "a", "b c" }), reply) && reply == std::string("got 6:a\0b c\0", 12));
+        CHECK(send_request(path, "", reply) && reply == "got 0:");
+
+        std::string big(1 << 20, 'x');
+        CHECK(send_request(path, big, reply) && reply == "got " + std::to_string(big.size()) + ":" + big);
+
+        // too long to send
+        std::string huge(SocketServer::MAX_MESSAGE + 1, 'y');
+        CHECK(!send_request(path, huge, reply, &error) && !error.empty());
+
+        // requests on one connection are answered in order, and one announcing too much ends the connection
+        int fd = raw_connect(path);
+        CHECK(fd >= 0);
+        CHECK(raw_send(fd, 3, "one") && raw_send(fd, 3, "two"));
+        CHECK(raw_receive(fd, reply) && reply == "got 3:one");
+        CHECK(raw_receive(fd, reply) && reply == "got 3:two");
+        CHECK(raw_send(fd, SocketServer::MAX_MESSAGE + 1, "z"));
+        CHECK(!raw_receive(fd, reply));
+        close(fd);
+
+        // a request cut short gets no reply
+        fd = raw_connect(path);
+        CHECK(fd >= 0 && raw_send(fd, 10, "short"));
+        shutdown(fd, SHUT_WR);
+        CHECK(!raw_receive(fd, reply));
+        close(fd);
+
+        stop = 1;
+        runner.join();
+    }
+
+    std::string error, reply;
+    CHECK(!send_request(path, "", reply, &error) && !error.empty());
+
+    // the refusals of the server itself
+    std::string bacon = base.substr(0, base.find_last_of('/') + 1) + "bacon";
+    if (access(bacon.c_str(), X_OK) == 0) {
+        std::string home = base + ".home";
+        mkdir(home.c_str(), 0755);
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            setenv("HOME", home.c_str(), 1);
+            setenv("BACON_SOCKET", path.c_str(), 1);
+            setenv("BACON_CACHE_MB", "lots", 1);
+            if (!freopen("/dev/null", "w", stdout)) _exit(1);
+            execl(bacon.c_str(), bacon.c_str(), "serve", "1", (char *)NULL);
+            _exit(1);
+        }
+
+        // wait for it to listen
+        bool up = false;
+        for (int tries = 0; tries < 300 && !up; ++tries) {
+            up = send_request(path, request({ "-ls" }), reply);
+            if (!up) usleep(100000);
+        }
+        CHECK(up && reply[0] == '0');
+
+        CHECK(send_request(path, "", reply) && reply == "1Empty request.\n");
+        CHECK(send_request(path, request({ "-r", "_human", "_swap" }), reply) && reply[0] == '1');
+        CHECK(send_request(path, request({ "-r", "_nonexistent", "_swap" }), reply) && reply[0] == '1');
+        CHECK(send_request(path, request({ "mkfinal" }), reply) && reply[0] == '1');
+        CHECK(send_request(path, request({ "-r" }), reply) && reply[0] == '1');
+
+        // a tournament needs a results file
+        CHECK(send_request(path, request({ "-t", "1" }), reply) && reply[0] == '1');
+        CHECK(send_request(path, request({ "swiss", "-f" }), reply) && reply[0] == '1');
+
+        CHECK(send_request(path, request({ "-r", "_final", "_swap" }), reply) && reply.compare(0, 11, "0Win rate: ") == 0);
+
+        // warnings on stderr are part of the reply (the server was given a bad BACON_CACHE_MB)
+        std::string results_path = base + ".results.txt";
+        CHECK(send_request(path, request({ "-t", "1", "-f", results_path }), reply) && reply[0] == '0' &&
+            reply.find("Warning: BACON_CACHE_MB") != std::string::npos);
+        std::remove(results_path.c_str());
+
+        // no more threads than cores, however many are asked for
+        CHECK(send_request(path, request({ "-r", "_final", "_swap", "1000000" }), reply) &&
+            reply.compare(0, 11, "0Win rate: ") == 0 && reply.find("one per core") != std::string::npos);
+
+        kill(pid, SIGINT);
+        int status;
+        CHECK(waitpid(pid, &status, 0) == pid && WIFEXITED(status));
+
+        std::string dir = home + "/.bacon";
+        for (const char * name : { "strategies.dat", "learn.dat", "options.dat", "matchups.dat" })
+            std::remove((dir + "/" + name).c_str());
+        rmdir(dir.c_str());
+        rmdir(home.c_str());
+    }
+    else {
+        std::cout << "test_server: " << bacon << " is not built, skipping the server's own replies" << std::endl;
+    }
+
+    return check_result("test_server");
+}
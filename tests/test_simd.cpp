@@ -0,0 +1,43 @@
+#include "stdafx.h"
+#include "simd.h"
+#include "check.h"
+
+#include <random>
+
+// The gather kernels selected for this CPU (or by BACON_SIMD) against the portable ones
+int main() {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+    const int TABLE = 4096, COUNT = 300, STRIDE = GATHER_GROUPS * GATHER_LANES + 3;
+
+    std::vector<double> values(TABLE * STRIDE), weight(COUNT);
+    std::vector<unsigned short> index(COUNT);
+    for (auto & v : values) v = unit(gen);
+
+    GatherDotKernel dot = gather_dot_kernel();
+    GatherLanesKernel lanes = gather_lanes_kernel();
+    std::cout << "Kernels: " << simd_name() << std::endl;
+
+    // every count from 0 up, so that each length of the remainder loops is covered
+    for (int count = 0; count <= COUNT; ++count) {
+        for (int j = 0; j < count; ++j) {
+            weight[j] = unit(gen);
+            index[j] = (unsigned short)(gen() % TABLE);
+        }
+
+        double expected = gather_dot_scalar(weight.data(), index.data(), values.data(), count);
+        double got = dot(weight.data(), index.data(), values.data(), count);
+        CHECK(std::fabs(got - expected) <= 1e-12 * std::max(1.0, std::fabs(expected)));
+
+        // the lanes kernels must match exactly, for one group and for all of them
+        for (int groups : { 1, GATHER_GROUPS }) {
+            double want[GATHER_GROUPS * GATHER_LANES], out[GATHER_GROUPS * GATHER_LANES];
+            gather_lanes_scalar(weight.data(), index.data(), values.data(), STRIDE, groups, count, want);
+            lanes(weight.data(), index.data(), values.data(), STRIDE, groups, count, out);
+            CHECK(memcmp(want, out, sizeof(double) * groups * GATHER_LANES) == 0);
+        }
+    }
+
+    return check_result("test_simd");
+}
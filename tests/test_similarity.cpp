@@ -0,0 +1,69 @@
+#include "stdafx.h"
+#include "analysis.h"
+#include "tournament.h"
+#include "winrates.h"
+#include "check.h"
+
+#include <random>
+
+// A round robin with similarity ordering reports exactly the win rates and wins of a plain one, under every rule set
+int main() {
+    std::mt19937 gen(5);
+
+    // two random strategies, each with variants differing from it in a few cells at low scores, so that runs form
+    std::vector<MatrixStrategy> mats(12);
+    for (size_t k = 0; k < mats.size(); ++k) {
+        for (int i = 0; i < GOAL; ++i) {
+            for (int j = 0; j < GOAL; ++j) {
+                if (k % 6 == 0) mats[k].set_roll_num(i, j, gen() % 3 ? (i + j + (int)k) % 6 + 1 : (int)(gen() % (MAX_ROLLS + 1)));
+                else mats[k].set_roll_num(i, j, mats[k - k % 6].get_roll_num(i, j));
+            }
+        }
+
+        for (size_t c = 0; c < k % 6; ++c) {
+            int i = 5 + (int)(gen() % 20), j = 5 + (int)(gen() % 20);
+            mats[k].set_roll_num(i, j, (mats[k].get_roll_num(i, j) + 1 + (int)c) % (MAX_ROLLS + 1));
+        }
+    }
+
+    std::vector<std::pair<std::string, IStrategy *> > strats;
+    std::vector<std::string> names;
+    for (size_t k = 0; k < mats.size(); ++k) {
+        names.push_back("strat" + std::to_string(k));
+        strats.emplace_back(names.back(), &mats[k]);
+    }
+
+    int saved_trot = enable_time_trot, saved_swap = enable_swine_swap;
+
+    for (int rules = 0; rules < 4; ++rules) {
+        enable_time_trot = rules & 1;
+        enable_swine_swap = rules >> 1;
+
+        for (int threads = 1; threads <= 2; ++threads) {
+            WinRateMatrix plain_rates(strats.size()), chained_rates(strats.size());
+            std::vector<std::pair<int, std::string> > plain_victories, chained_victories;
+
+            RoundRobinOptions plain, chained;
+            plain.threads = chained.threads = threads;
+            plain.win_rates = &plain_rates;
+            chained.win_rates = &chained_rates;
+            chained.similarity = true;
+
+            round_robin(strats, plain_victories, plain);
+            TournamentStats stats = round_robin(strats, chained_victories, chained);
+            CHECK(stats.games_reused > 0);
+
+            for (size_t i = 0; i < strats.size(); ++i) {
+                for (size_t j = i + 1; j < strats.size(); ++j) {
+                    CHECK(chained_rates.has(i, j) && chained_rates.get(i, j) == plain_rates.get(i, j));
+                }
+            }
+            CHECK(chained_victories == plain_victories);
+        }
+    }
+
+    enable_time_trot = saved_trot;
+    enable_swine_swap = saved_swap;
+
+    return check_result("test_similarity");
+}
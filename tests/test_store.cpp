@@ -0,0 +1,105 @@
+#include "stdafx.h"
+#include "store.h"
+#include "check.h"
+
+#include <memory>
+
+// A strategy whose roll numbers are determined by 'seed'
+MatrixStrategy make_strategy(int seed) {
+    MatrixStrategy strat;
+    for (int i = 0; i < GOAL; ++i) {
+        for (int j = 0; j < GOAL; ++j) strat.set_roll_num(i, j, (i * 7 + j * 3 + seed) % (MAX_ROLLS + 1));
+    }
+    return strat;
+}
+
+// Returns true if the store holds the strategy of 'seed' under the name
+bool holds(StrategyStore & store, const std::string & name, int seed) {
+    std::unique_ptr<MatrixStrategy> loaded(store.load(name));
+    MatrixStrategy expected = make_strategy(seed);
+    return loaded && memcmp(loaded->cells(), expected.cells(), GOAL * GOAL) == 0;
+}
+
+// StrategyStore: storing, replacing, removing and clearing strategies, reopening, and two users of one file
+int main(int argc, char ** argv) {
+    std::string path = std::string(argc > 0 ? argv[0] : "test_store") + ".dat";
+    std::remove(path.c_str());
+
+    // more strategies than the initial index holds, so that it grows
+    const int MANY = 300;
+    {
+        StrategyStore store(path);
+        CHECK(store.ok() && store.size() == 0);
+
+        for (int k = 0; k < MANY; ++k) {
+            MatrixStrategy strat = make_strategy(k);
+            CHECK(store.put("strat" + std::to_string(k), strat));
+        }
+        MatrixStrategy replaced = make_strategy(1000), derived = make_strategy(2000);
+        CHECK(store.put("strat5", replaced) && store.put_derived("key", derived));
+        CHECK(store.commit());
+
+        CHECK(store.size() == MANY && holds(store, "strat5", 1000) && holds(store, "strat6", 6));
+        CHECK(!store.contains("key") && store.load("key") == NULL);
+
+        CHECK(store.remove("strat6") && !store.remove("strat6") && !store.contains("strat6") && store.load("strat6") == NULL);
+        CHECK(!store.remove("key"));
+
+        std::string too_long(StrategyStore::MAX_NAME + 1, 'x');
+        CHECK(!store.put(too_long, replaced));
+    }
+
+    // everything is there once reopened
+    {
+        StrategyStore store(path);
+        CHECK(store.ok() && store.size() == MANY - 1);
+        CHECK(holds(store, "strat0", 0) && holds(store, "strat5", 1000) && holds(store, "strat" + std::to_string(MANY - 1), MANY - 1));
+        CHECK(!store.contains("strat6"));
+
+        std::unique_ptr<MatrixStrategy> derived(store.load_derived("key"));
+        MatrixStrategy expected = make_strategy(2000);
+        CHECK(derived && memcmp(derived->cells(), expected.cells(), GOAL * GOAL) == 0);
+
+        std::vector<std::string> names = store.names();
+        CHECK(names.size() == MANY - 1 && std::is_sorted(names.begin(), names.end()));
+    }
+
+    // two users of the file (as two processes would be) see each other's changes and never share a slot
+    {
+        StrategyStore first(path), second(path);
+        CHECK(first.ok() && second.ok());
+
+        MatrixStrategy a = make_strategy(3000), b = make_strategy(4000);
+        CHECK(first.remove("strat0") && second.put("new", a) && first.put("other", b));
+        CHECK(holds(first, "new", 3000) && holds(second, "other", 4000) && holds(second, "new", 3000));
+        CHECK(second.load("strat0") == NULL && !second.remove("strat0"));
+
+        // clearing leaves the other user's mapping valid, and the store usable by both
+        first.clear();
+        CHECK(first.size() == 0 && second.load("new") == NULL && second.load_derived("key") == NULL);
+        CHECK(second.size() == 0 && second.put("after", a) && holds(first, "after", 3000));
+    }
+
+    {
+        StrategyStore store(path);
+        CHECK(store.ok() && store.size() == 1 && holds(store, "after", 3000));
+    }
+
+    // a file that is not a store is refused, and left as it is
+    {
+        std::ofstream ofs(path, std::ofstream::trunc);
+        ofs << "not a strategy store\n";
+    }
+    {
+        StrategyStore store(path);
+        CHECK(!store.ok());
+    }
+    std::ifstream ifs(path);
+    std::string line;
+    CHECK(std::getline(ifs, line) && line == "not a strategy store");
+    ifs.close();
+
+    std::remove(path.c_str());
+
+    return check_result("test_store");
+}
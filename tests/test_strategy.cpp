@@ -0,0 +1,58 @@
+#include "stdafx.h"
+#include "strategy.h"
+#include "check.h"
+
+// A strategy returning fixed roll numbers, including some out of range
+class ConstantStrategy : public IStrategy {
+public:
+    explicit ConstantStrategy(int roll) : roll(roll) {}
+    int operator()(int, int) { return roll; }
+    int roll;
+};
+
+// MatrixStrategy roll numbers stay within 0 .. MAX_ROLLS, however they are given, and strategy files are read strictly
+int main(int argc, char ** argv) {
+    MatrixStrategy mat("clamped");
+    CHECK(mat.set_roll_num(1, 2, MAX_ROLLS) && mat(1, 2) == MAX_ROLLS);
+    CHECK(!mat.set_roll_num(1, 2, -1) && mat(1, 2) == 0);
+    CHECK(!mat.set_roll_num(1, 2, 300) && mat(1, 2) == MAX_ROLLS);
+
+    ConstantStrategy below(-1), above(MAX_ROLLS + 1), inside(3);
+    CHECK(MatrixStrategy(below, "below")(5, 5) == 0);
+    CHECK(MatrixStrategy(above, "above")(5, 5) == MAX_ROLLS);
+    CHECK(MatrixStrategy(inside, "inside")(5, 5) == 3);
+
+    std::vector<int> storage(GOAL * GOAL, 2);
+    std::vector<int *> rows(GOAL);
+    for (int i = 0; i < GOAL; ++i) rows[i] = &storage[i * GOAL];
+    rows[4][7] = -1;
+    rows[7][4] = 256;
+
+    MatrixStrategy from_array(rows.data(), "array");
+    CHECK(from_array(4, 7) == 0 && from_array(7, 4) == MAX_ROLLS && from_array(0, 0) == 2);
+
+    // a written strategy loads back, but not with anything after its roll numbers
+    std::string path = std::string(argc > 0 ? argv[0] : "test_strategy") + ".txt";
+    from_array.write_to_file(path);
+
+    MatrixStrategy loaded;
+    std::string error;
+    CHECK(loaded.load_from_file(path, &error) && loaded.name == "array" &&
+        memcmp(loaded.cells(), from_array.cells(), GOAL * GOAL) == 0);
+
+    const char * trailing[] = { "5\n", "x", "-1" };
+    for (const char * extra : trailing) {
+        { std::ofstream ofs(path, std::ofstream::app); ofs << " \n" << extra; }
+
+        MatrixStrategy rejected("unchanged");
+        CHECK(!rejected.load_from_file(path, &error) && rejected.name == "unchanged" && error.find("after the") != std::string::npos);
+
+        from_array.write_to_file(path);
+    }
+
+    { std::ofstream ofs(path, std::ofstream::app); ofs << " \t\n\n"; }
+    CHECK(loaded.load_from_file(path));
+    std::remove(path.c_str());
+
+    return check_result("test_strategy");
+}
@@ -0,0 +1,80 @@
+#include "stdafx.h"
+#include "analysis.h"
+#include "tournament.h"
+#include "winrates.h"
+#include "check.h"
+
+#include <random>
+
+// An announcer that prints nothing
+void quiet(int, int, int, std::string) {}
+
+/* The win rates a round robin reports are the exact ones, and its wins are counted from them;
+   a Swiss tournament of an odd field gives each bye a full point */
+int main() {
+    std::mt19937 gen(11);
+
+    // random strategies, one of them twice so that a class of equivalent strategies is formed
+    std::vector<MatrixStrategy> mats(7);
+    for (size_t k = 0; k < mats.size(); ++k) {
+        for (int i = 0; i < GOAL; ++i) {
+            for (int j = 0; j < GOAL; ++j) {
+                mats[k].set_roll_num(i, j, k == mats.size() - 1 ? mats[0].get_roll_num(i, j) :
+                    gen() % 4 ? (i + j + (int)k) % 5 + 2 : (int)(gen() % (MAX_ROLLS + 1)));
+            }
+        }
+    }
+
+    std::vector<std::pair<std::string, IStrategy *> > strats;
+    std::vector<std::string> names;
+    for (size_t k = 0; k < mats.size(); ++k) {
+        names.push_back("strat" + std::to_string(k));
+        strats.emplace_back(names.back(), &mats[k]);
+    }
+
+    for (int threads = 1; threads <= 2; ++threads) {
+        WinRateMatrix win_rates(strats.size());
+        std::vector<std::pair<int, std::string> > victories;
+
+        RoundRobinOptions options;
+        options.threads = threads;
+        options.win_rates = &win_rates;
+
+        TournamentStats stats = round_robin(strats, victories, options);
+        CHECK(stats.distinct_strategies == (int)strats.size() - 1 && stats.games == 21 && stats.games_evaluated == 15);
+
+        for (size_t i = 0; i < strats.size(); ++i) {
+            for (size_t j = i + 1; j < strats.size(); ++j) {
+                CHECK(win_rates.has(i, j));
+
+                double exact = i == 0 && j == strats.size() - 1 ? 0.5 : average_win_rate(mats[i], mats[j]);
+                CHECK(std::fabs(win_rates.get(i, j) - exact) < 1e-12);
+            }
+        }
+
+        std::vector<std::pair<int, std::string> > counted;
+        count_victories(names, win_rates, counted);
+        CHECK(counted == victories);
+    }
+
+    // 7 strategies: each round has 3 games and a bye, and the byes go to different strategies
+    const int ROUNDS = 3;
+    std::vector<SwissStanding> standings;
+    TournamentStats stats = swiss(strats, standings, ROUNDS, NULL, 0.500001, 2);
+    CHECK(stats.games == ROUNDS * 3 && standings.size() == strats.size());
+
+    double points = 0.0;
+    int sat_out = 0;
+    for (const SwissStanding & s : standings) {
+        points += s.points;
+        if (s.games == ROUNDS - 1) ++sat_out;
+        CHECK(s.games >= ROUNDS - 1 && s.points <= ROUNDS);
+    }
+    CHECK(points == ROUNDS * 4.0 && sat_out == ROUNDS);
+
+    // an empty field has nothing to play, and no leader to announce
+    std::vector<std::pair<std::string, IStrategy *> > none;
+    CHECK(swiss(none, standings, ROUNDS, quiet).games == 0 && standings.empty());
+
+    return check_result("test_tournament");
+}
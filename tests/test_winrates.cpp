@@ -0,0 +1,91 @@
+#include "stdafx.h"
+#include "winrates.h"
+#include "tournament.h"
+#include "check.h"
+
+// WinRateMatrix in memory and backed by binary win rate files, read back with WinRateFile and through shard files
+int main(int argc, char ** argv) {
+    std::string base = std::string(argc > 0 ? argv[0] : "test_winrates");
+    std::string file_path = base + ".bin", shard_path = base + ".shard";
+
+    // just under the default margin, but not once rounded to a float
+    const double close = 0.500000995;
+    CHECK(close < 0.500001 && (float)close > 0.500001);
+
+    WinRateMatrix memory(3);
+    CHECK(!memory.has(0, 1) && memory.has(2, 2) && memory.get(2, 2) == 0.5);
+    memory.set(2, 0, 0.25);
+    CHECK(memory.get(0, 2) == 0.75 && memory.get(2, 0) == 0.25 && memory.has(0, 2) && !memory.has(1, 2));
+
+    std::vector<std::string> names = { "first", "second", "third strategy", "fourth" };
+
+    for (int single = 0; single < 2; ++single) {
+        {
+            WinRateMatrix matrix(file_path, names, single != 0);
+            CHECK(matrix.ok() && matrix.size() == names.size());
+
+            matrix.set(0, 1, close);
+            matrix.set(3, 0, 0.125);
+            matrix.set(1, 2, 0.9);
+
+            // the matrix keeps the exact doubles, whatever the file holds
+            CHECK(matrix.get(0, 1) == close && matrix.get(1, 0) == 1.0 - close);
+            CHECK(!matrix.has(2, 3));
+
+            // the file can be read while it is being filled in
+            {
+                WinRateFile partial(file_path);
+                CHECK(partial.ok() && std::isnan(partial.get(2, 3)) && partial.get(1, 2) == (single ? (double)(float)0.9 : 0.9));
+            }
+            matrix.set(2, 3, 0.5);
+            matrix.set(2, 0, 0.5);
+            matrix.set(1, 3, 0.5);
+
+            // winners are decided at double precision: 'close' is a tie
+            std::vector<std::pair<int, std::string> > victories;
+            count_victories(names, matrix, victories);
+            std::map<std::string, int> wins;
+            for (auto & v : victories) wins[v.second] = v.first;
+            CHECK(wins["first"] == 1 && wins["second"] == 1 && wins["third strategy"] == 0 && wins["fourth"] == 0);
+
+            // and shard files get them too
+            MatrixStrategy strats_storage[4];
+            std::vector<std::pair<std::string, IStrategy *> > strats;
+            for (size_t i = 0; i < names.size(); ++i) strats.emplace_back(names[i], &strats_storage[i]);
+            CHECK(write_shard_results(shard_path, 0, 1, strats, matrix));
+
+            CHECK(matrix.flush());
+        }
+
+        std::vector<std::string> merged_names;
+        WinRateMatrix merged;
+        std::string error;
+        CHECK(read_shard_results(std::vector<std::string>(1, shard_path), merged_names, merged, error));
+        CHECK(merged_names == names && merged.get(0, 1) == close && merged.get(0, 3) == 0.875 && merged.get(3, 2) == 0.5);
+
+        // the file holds doubles, or floats with --float32
+        WinRateFile file(file_path);
+        CHECK(file.ok() && file.size() == names.size() && file.name(2) == "third strategy");
+        CHECK(file.get(0, 1) == (single ? (double)(float)close : close));
+        CHECK(file.get(0, 3) == 0.875 && file.get(3, 0) == 0.125);
+        CHECK(file.get(2, 3) == 0.5 && file.get(1, 1) == 0.5);
+
+        std::vector<double> row;
+        file.row(1, row);
+        CHECK(row.size() == names.size() && row[1] == 0.5 && row[2] == (single ? (double)(float)0.9 : 0.9) &&
+            row[0] == 1.0 - (single ? (double)(float)close : close));
+    }
+
+    // anything else is refused
+    {
+        std::ofstream ofs(file_path, std::ofstream::trunc);
+        ofs << "not a win rate file\n";
+    }
+    WinRateFile bad(file_path);
+    CHECK(!bad.ok() && bad.size() == 0);
+
+    std::remove(file_path.c_str());
+    std::remove(shard_path.c_str());
+
+    return check_result("test_winrates");
+}
@@ -0,0 +1,1166 @@
+#include "stdafx.h"
+#include "tournament.h"
+#include "analysis.h"
+#include "cache.h"
+#include "pool.h"
+#include "transition.h"
+#include "hog.h"
+#include "winrates.h"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// hide from linkage
+namespace {
+    // sorts by wins in descending order, then sorts by names alphabetically
+    bool wins_comparer(const std::pair<int, std::string> & a, const std::pair<int, std::string> & b) {
+        if (a.first > b.first) return true;
+        else if (a.first < b.first) return false;
+        else return a.second < b.second;
+    }
+
+    // Returns true if the two strategies roll the same number of dice at every pair of scores
+    bool same_rolls(MatrixStrategy & a, MatrixStrategy & b) {
+        for (int i = 0; i < GOAL; ++i) {
+            for (int j = 0; j < GOAL; ++j) {
+                if (a.get_roll_num(i, j) != b.get_roll_num(i, j)) return false;
+            }
+        }
+        return true;
+    }
+
+    // Winner of a game with average win rate 'avr' for the first player: 0 or 1, or -1 for a tie
+    inline int game_winner(double avr, double margin) {
+        if (avr > margin) return 0;
+        if (avr < 1.0 - margin) return 1;
+        return -1;
+    }
+
+    // header of partial results files
+    const char * SHARD_FILE_HEADER = "bacon_shard";
+
+    // version of the partial results file format
+    const int SHARD_FILE_VERSION = 1;
+
+    // header of tournament journals
+    const char * JOURNAL_HEADER = "bacon_journal";
+
+    // version of the journal format
+    const int JOURNAL_VERSION = 1;
+
+    // key of the game between strategies i and j in a journal
+    inline unsigned long long journal_key(int i, int j) {
+        return (unsigned long long)i << 32 | (unsigned)j;
+    }
+
+    // Flushes a file and waits until its contents are on disk
+    bool sync_file(FILE * file) {
+        if (fflush(file) != 0) return false;
+    #ifdef _WIN32
+        return _commit(_fileno(file)) == 0;
+    #else
+        return fsync(fileno(file)) == 0;
+    #endif
+    }
+
+    /* Groups the strategies into classes by their roll matrices with unreachable cells masked (the first member
+       of each class plays for all of them), and gives the fingerprint of each class (0 if it has no roll matrix,
+       so can not be cached). Matrices with equal fingerprints are compared in full before being grouped.
+       If 'canonical_out' is given, it receives the masked roll matrix of each class (NULL if it has none). */
+    void group_strategies(std::vector<std::pair<std::string, IStrategy *> > & strats,
+        std::vector<std::vector<int> > & classes, std::vector<unsigned long long> & keys,
+        std::vector<std::unique_ptr<MatrixStrategy> > * canonical_out = NULL) {
+
+        std::vector<std::unique_ptr<MatrixStrategy> > canonical;
+        std::map<unsigned long long, std::vector<int> > classes_by_key;
+
+        for (size_t i = 0; i < strats.size(); ++i) {
+            MatrixStrategy * mat = dynamic_cast<MatrixStrategy *>(strats[i].second);
+            unsigned long long key = 0;
+            int found = -1;
+
+            if (mat) {
+                std::unique_ptr<MatrixStrategy> masked(new MatrixStrategy(*mat));
+                mask_unreachable(*masked);
+                key = MatchupCache::fingerprint(*masked);
+
+                for (int c : classes_by_key[key]) {
+                    if (same_rolls(*canonical[c], *masked)) found = c;
+                }
+
+                if (found == -1) {
+                    classes_by_key[key].push_back((int)classes.size());
+                    canonical.push_back(std::move(masked));
+                }
+            }
+            else {
+                canonical.push_back(nullptr);
+            }
+
+            if (found == -1) {
+                classes.push_back(std::vector<int>(1, (int)i));
+                keys.push_back(key);
+            }
+            else {
+                classes[found].push_back((int)i);
+            }
+        }
+
+        if (canonical_out) canonical_out->swap(canonical);
+    }
+
+    // Position of the game between classes x <= y in the order x = 0 .. K - 1, y = x .. K - 1
+    inline size_t class_pair_index(size_t x, size_t y, size_t K) {
+        return x * K - x * (x - 1) / 2 + (y - x);
+    }
+
+    // most games in one chain of games between near-identical classes (see Matchups)
+    const int REUSE_CHAIN = 32;
+
+    /* largest share of the states that switching to a neighbouring class of a run may recompute: an update costs
+       about twice as much per state as a batched sweep, and more past a few cells at high scores (see update_cost) */
+    const double REUSE_MAX_COST = 0.3;
+
+    /* A work unit, played by the first member of each class. Either a single batch: class of strategies 'row'
+       against the classes in cols[0 .. count - 1] (up to WIN_RATE_BATCH), or, with 'chain', up to REUSE_CHAIN
+       games of class rows[c] against class cols[c] in which consecutive games differ in a single class,
+       replaced by a near-identical one, so that each is played by updating the DP table of the one before. */
+    struct Matchups {
+        int row, count;
+        bool chain;
+        int rows[REUSE_CHAIN], cols[REUSE_CHAIN];
+    };
+
+    /* The range [begin, end) of work units left to one thread, packed in a single atomic word.
+       The owner takes units from the front and thieves take the back half, each with one compare-and-swap,
+       so no unit is ever lost or done twice. Units never return to a range once taken, so a stale
+       range can not reappear and pass the compare-and-swap. */
+    class WorkRange {
+    public:
+        WorkRange() : range(0) {}
+
+        // Replaces the range (only while no other thread can steal from it, or by its owner once empty)
+        void reset(unsigned begin, unsigned end) {
+            range.store(pack(begin, end));
+        }
+
+        // Number of units left
+        unsigned size() const {
+            unsigned long long cur = range.load();
+            return lo(cur) < hi(cur) ? hi(cur) - lo(cur) : 0;
+        }
+
+        // Takes the first unit of the range. Returns false if the range is empty.
+        bool take(unsigned & unit) {
+            unsigned long long cur = range.load();
+            while (lo(cur) < hi(cur)) {
+                if (range.compare_exchange_weak(cur, pack(lo(cur) + 1, hi(cur)))) {
+                    unit = lo(cur);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /* Moves the back half of the units of 'victim' (at least one) to this range, which must be empty.
+           Returns false if the victim has no units left. */
+        bool steal(WorkRange & victim) {
+            unsigned long long cur = victim.range.load();
+            while (lo(cur) < hi(cur)) {
+                unsigned mid = lo(cur) + (hi(cur) - lo(cur)) / 2;
+                if (victim.range.compare_exchange_weak(cur, pack(lo(cur), mid))) {
+                    reset(mid, hi(cur));
+                    return true;
+                }
+            }
+            return false;
+        }
+
+    private:
+        static unsigned long long pack(unsigned begin, unsigned end) {
+            return (unsigned long long)begin << 32 | end;
+        }
+        static unsigned lo(unsigned long long r) { return (unsigned)(r >> 32); }
+        static unsigned hi(unsigned long long r) { return (unsigned)r; }
+
+        std::atomic<unsigned long long> range;
+
+        // keep each range on its own cache line
+        char padding[64 - sizeof(std::atomic<unsigned long long>)];
+    };
+
+    // State shared by the threads of a round-robin tournament
+    struct RoundRobin {
+        std::vector<std::pair<std::string, IStrategy *> > * strats;
+        std::vector<Matchups> units;
+        std::vector<WorkRange> ranges;
+
+        /* wins[t * N + i]: wins of strategy i counted by thread t. Only thread t writes its row;
+           atomic so that the announcer may read the others' rows while they run. */
+        std::unique_ptr<std::atomic<int>[]> wins;
+
+        // number of games this tournament (or shard) plays, and the number played so far
+        int total_games;
+        std::atomic<int> games_played;
+        std::mutex announcer_mtx;
+
+        void (*announcer)(int games_played, int games_remaining, int high, std::string high_strat);
+        int announcer_interval;
+        double margin;
+        WinRateMatrix * win_rates;
+        volatile int * interrupt;
+
+        /* classes of equivalent strategies (equal roll matrices after masking unreachable cells), by first member,
+           and the fingerprint of each class (0 if it has no roll matrix, so can not be cached) */
+        std::vector<std::vector<int> > classes;
+        std::vector<unsigned long long> keys;
+
+        MatchupCache * cache;
+        TournamentJournal * journal;
+
+        TournamentTelemetry * telemetry;
+
+        /* with similarity ordering: the masked roll matrix of each class (NULL if it has none), the run of
+           near-identical neighbours each class belongs to (-1 if none) and its place in the order of the runs */
+        bool similarity;
+        std::vector<std::unique_ptr<MatrixStrategy> > canonical;
+        std::vector<int> run, position;
+
+        // games evaluated by updating the DP table of the previous game of a chain, and the states that saved
+        std::atomic<int> games_reused;
+        std::atomic<long long> states_saved;
+    };
+
+    /* Announces the progress of the tournament, with the current leader across all scoreboards.
+       Skipped if another thread is announcing, rather than waiting for it. */
+    void announce(RoundRobin & rr, int games_played, int threads) {
+        std::unique_lock<std::mutex> lck(rr.announcer_mtx, std::try_to_lock);
+        if (!lck.owns_lock()) return;
+
+        size_t N = rr.strats->size();
+        int high = 0, high_strat = 0;
+
+        for (size_t i = 0; i < N; ++i) {
+            int total = 0;
+            for (int t = 0; t < threads; ++t) total += rr.wins[t * N + i].load(std::memory_order_relaxed);
+
+            if (total > high) {
+                high = total;
+                high_strat = (int)i;
+            }
+        }
+
+        rr.announcer(games_played, rr.total_games - games_played, high, rr.strats->at(high_strat).first);
+    }
+
+    // Records the result of strategy i against strategy j on the scoreboard of thread 'thread_id'
+    void record_result(RoundRobin & rr, int i, int j, double avr, int thread_id, int threads) {
+        size_t N = rr.strats->size();
+
+        if (rr.win_rates) rr.win_rates->set(i, j, avr);
+
+        int winner = game_winner(avr, rr.margin);
+
+        if (winner != -1) {
+            std::atomic<int> & wins = rr.wins[thread_id * N + (winner ? j : i)];
+            wins.store(wins.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
+        int games_played = ++rr.games_played;
+
+        if (games_played % rr.announcer_interval == 0 && rr.announcer != NULL) {
+            announce(rr, games_played, threads);
+        }
+    }
+
+    /* Records the result of class x against class y for every pair of their members. For x == y, each pair
+       of distinct members is recorded once (a strategy never plays itself) */
+    void record_class_result(RoundRobin & rr, int x, int y, double avr, int thread_id, int threads) {
+        if (x == y) {
+            const std::vector<int> & members = rr.classes[x];
+            for (size_t a = 0; a < members.size(); ++a) {
+                for (size_t b = a + 1; b < members.size(); ++b) record_result(rr, members[a], members[b], avr, thread_id, threads);
+            }
+            return;
+        }
+
+        for (int i : rr.classes[x]) {
+            for (int j : rr.classes[y]) {
+                if (i < j) record_result(rr, i, j, avr, thread_id, threads);
+                else record_result(rr, j, i, 1.0 - avr, thread_id, threads);
+            }
+        }
+    }
+
+    // Records the evaluated result of class x against class y in the journal, the cache and the scoreboard
+    void finish_matchup(RoundRobin & rr, int x, int y, double avr, int thread_id, int threads) {
+        if (rr.journal) rr.journal->append(rr.classes[x][0], rr.classes[y][0], avr);
+
+        if (rr.cache && rr.keys[x] && rr.keys[y]) rr.cache->insert(rr.keys[x], rr.keys[y], avr);
+
+        record_class_result(rr, x, y, avr, thread_id, threads);
+    }
+
+    /* Evaluates a chain of games: the first with a full sweep, each of the others by switching the class
+       that differs from the game before in the same DP table, recomputing only the states its changed cells affect */
+    void play_chain(RoundRobin & rr, const Matchups & unit, int thread_id, int threads) {
+        IncrementalWinRate table(*rr.canonical[unit.rows[0]], *rr.canonical[unit.cols[0]]);
+        long long total = IncrementalWinRate::total_states(), counted = 0;
+
+        for (int c = 0; c < unit.count; ++c) {
+            if (c > 0) {
+                if (rr.interrupt && *rr.interrupt) return;
+
+                table.set_strategy(0, *rr.canonical[unit.rows[c]]);
+                table.set_strategy(1, *rr.canonical[unit.cols[c]]);
+                ++rr.games_reused;
+                rr.states_saved += total - (table.states_touched() - counted);
+            }
+
+            if (rr.telemetry) rr.telemetry->record(thread_id, 1, table.states_touched() - counted);
+            counted = table.states_touched();
+
+            finish_matchup(rr, unit.rows[c], unit.cols[c], table.win_rate(), thread_id, threads);
+        }
+    }
+
+    // Evaluates one work unit on thread 'thread_id', recording the results on its scoreboard and in the cache
+    void play_matchups(RoundRobin & rr, const Matchups & unit, int thread_id, int threads) {
+        if (unit.chain) {
+            play_chain(rr, unit, thread_id, threads);
+            return;
+        }
+
+        std::vector<IStrategy *> opponents;
+        for (int c = 0; c < unit.count; ++c) opponents.push_back(rr.strats->at(rr.classes[unit.cols[c]][0]).second);
+
+        double batch_win_rates[WIN_RATE_BATCH];
+        long long states = states_computed(thread_id);
+        average_win_rates(*rr.strats->at(rr.classes[unit.row][0]).second, opponents, batch_win_rates, -1, thread_id);
+
+        if (rr.telemetry) rr.telemetry->record(thread_id, unit.count, states_computed(thread_id) - states);
+
+        for (int c = 0; c < unit.count; ++c) {
+            finish_matchup(rr, unit.row, unit.cols[c], batch_win_rates[c], thread_id, threads);
+        }
+    }
+
+    // Main loop of each tournament thread: work through its own range, then steal from the busiest thread
+    void round_robin_worker(RoundRobin & rr, int thread_id, int threads) {
+        WorkRange & own = rr.ranges[thread_id];
+
+        while (true) {
+            unsigned unit;
+
+            while (own.take(unit)) {
+                // interrupt not null & set
+                if (rr.interrupt && *rr.interrupt) return;
+
+                play_matchups(rr, rr.units[unit], thread_id, threads);
+            }
+
+            // pick the thread with the most units left; stop once all are empty
+            int victim = -1;
+            unsigned most = 0;
+
+            for (int t = 0; t < threads; ++t) {
+                unsigned left = rr.ranges[t].size();
+                if (t != thread_id && left > most) {
+                    most = left;
+                    victim = t;
+                }
+            }
+
+            if (victim == -1) return;
+            own.steal(rr.ranges[victim]);
+        }
+    }
+
+    /* Estimated share of the states recomputed when switching between two roll matrices (as strings of roll
+       numbers, row by row) in a DP table. A changed cell at (i, j) can only affect the states that can reach it,
+       which mostly have scores below i and j, so take the box under all the cells that differ. */
+    double update_cost(const std::string & a, const std::string & b) {
+        int top_i = -1, top_j = -1;
+
+        for (size_t k = 0; k < a.size(); ++k) {
+            if (a[k] == b[k]) continue;
+            top_i = std::max(top_i, (int)k / GOAL);
+            top_j = std::max(top_j, (int)k % GOAL);
+        }
+
+        return (double)(top_i + 1) * (top_j + 1) / (GOAL * GOAL);
+    }
+
+    /* Finds the runs of near-identical classes for similarity ordering: sorting the masked roll matrices
+       lexicographically keeps strategies that share all but a few cells together, and consecutive classes
+       cheap enough to switch between (see REUSE_MAX_COST) are joined into a run. Sets rr.run and rr.position. */
+    void find_similar_classes(RoundRobin & rr) {
+        size_t K = rr.classes.size();
+
+        std::vector<std::string> cells(K);
+        std::vector<int> order;
+
+        for (size_t x = 0; x < K; ++x) {
+            MatrixStrategy * mat = rr.canonical[x].get();
+            if (!mat) continue;
+
+            cells[x].assign((const char *)mat->cells(), GOAL * GOAL);
+            order.push_back((int)x);
+        }
+
+        std::sort(order.begin(), order.end(), [&cells](int a, int b) { return cells[a] < cells[b]; });
+
+        rr.run.assign(K, -1);
+        rr.position.assign(K, -1);
+
+        for (size_t p = 0; p < order.size(); ++p) {
+            rr.position[order[p]] = (int)p;
+            if (p == 0 || update_cost(cells[order[p - 1]], cells[order[p]]) > REUSE_MAX_COST) continue;
+
+            int & previous = rr.run[order[p - 1]];
+            if (previous == -1) previous = order[p - 1];
+            rr.run[order[p]] = previous;
+        }
+    }
+
+    /* Replaces the work units with the games between the pairs of classes x < y in 'pairs', which must be sorted:
+       each class against up to WIN_RATE_BATCH of the later ones at a time. With similarity ordering,
+       the games between two runs of near-identical classes (or one class and a run) form chains
+       instead, snaking through the block of games so that consecutive games differ in a single class. */
+    void make_units(RoundRobin & rr, const std::vector<std::pair<int, int> > & pairs) {
+        rr.units.clear();
+
+        std::vector<std::pair<int, int> > batched, linked;
+
+        if (rr.similarity) {
+            for (const std::pair<int, int> & p : pairs) {
+                bool in_run = rr.run[p.first] != -1 || rr.run[p.second] != -1;
+                if (in_run && rr.canonical[p.first] && rr.canonical[p.second]) linked.push_back(p);
+                else batched.push_back(p);
+            }
+        }
+        else {
+            batched = pairs;
+        }
+
+        // the block of a game: its classes' runs, or the classes themselves if not in a run (as -1 - class)
+        auto group = [&rr](int x) { return rr.run[x] != -1 ? rr.run[x] : -1 - x; };
+
+        std::sort(linked.begin(), linked.end(), [&rr, &group](const std::pair<int, int> & a, const std::pair<int, int> & b) {
+            if (group(a.first) != group(b.first)) return group(a.first) < group(b.first);
+            if (group(a.second) != group(b.second)) return group(a.second) < group(b.second);
+            if (a.first != b.first) return rr.position[a.first] < rr.position[b.first];
+
+            // along the row, in alternate directions on alternate rows
+            bool forward = rr.position[a.first] % 2 == 0;
+            return forward == (rr.position[a.second] < rr.position[b.second]);
+        });
+
+        for (size_t a = 0, b; a < linked.size(); a = b) {
+            for (b = a + 1; b < linked.size() && b - a < (size_t)REUSE_CHAIN && group(linked[b].first) == group(linked[a].first) &&
+                group(linked[b].second) == group(linked[a].second); ++b) {}
+
+            // a lone game gains nothing from a chain
+            if (b - a == 1) {
+                batched.push_back(linked[a]);
+                continue;
+            }
+
+            Matchups chain;
+            chain.row = linked[a].first;
+            chain.count = (int)(b - a);
+            chain.chain = true;
+            for (size_t k = a; k < b; ++k) {
+                chain.rows[k - a] = linked[k].first;
+                chain.cols[k - a] = linked[k].second;
+            }
+            rr.units.push_back(chain);
+        }
+
+        std::sort(batched.begin(), batched.end());
+
+        Matchups unit;
+        unit.row = -1;
+        unit.count = 0;
+        unit.chain = false;
+
+        for (const std::pair<int, int> & p : batched) {
+            if (unit.count && (p.first != unit.row || unit.count == WIN_RATE_BATCH)) {
+                rr.units.push_back(unit);
+                unit.count = 0;
+            }
+            unit.row = p.first;
+            unit.cols[unit.count++] = p.second;
+        }
+
+        if (unit.count) rr.units.push_back(unit);
+    }
+
+    // Deals out the work units evenly to the threads (stealing evens out the rest) and runs them
+    void run_units(RoundRobin & rr, int threads) {
+        std::vector<WorkRange> ranges(threads);
+        rr.ranges.swap(ranges);
+        for (int t = 0; t < threads; ++t) {
+            rr.ranges[t].reset((unsigned)(rr.units.size() * t / threads), (unsigned)(rr.units.size() * (t + 1) / threads));
+        }
+
+        if (threads == 1) {
+            round_robin_worker(rr, 0, 1);
+        }
+        else {
+            worker_pool(threads).run([&rr](int worker, int workers) { round_robin_worker(rr, worker, workers); });
+        }
+    }
+}
+
+// Run a round-robin tournament on [thread] threads
+TournamentStats round_robin(std::vector<std::pair<std::string, IStrategy *> > & strats,
+    std::vector<std::pair<int, std::string>> & victories, const RoundRobinOptions & options) {
+
+    // Compute permutations beforehand to prevent conflict between threads
+    compute_perms();
+
+    size_t N = strats.size();
+    int threads = std::max(options.threads, 1), shard = options.shard, shards = std::max(options.shards, 1);
+
+    RoundRobin rr;
+    rr.strats = &strats;
+    rr.announcer = options.announcer;
+    rr.announcer_interval = options.announcer_interval;
+    rr.margin = options.margin;
+    rr.win_rates = options.win_rates;
+    rr.interrupt = options.interrupt;
+    rr.games_played = 0;
+    rr.cache = options.cache;
+    rr.journal = options.journal;
+    rr.telemetry = options.telemetry;
+    rr.similarity = options.similarity;
+    rr.games_reused = 0;
+    rr.states_saved = 0;
+
+    rr.wins.reset(new std::atomic<int>[threads * N]);
+    for (size_t i = 0; i < threads * N; ++i) rr.wins[i] = 0;
+
+    group_strategies(strats, rr.classes, rr.keys, rr.similarity ? &rr.canonical : NULL);
+    size_t K = rr.classes.size();
+    if (rr.similarity) find_similar_classes(rr);
+
+    /* the games between classes x <= y, in order, are dealt out to the shards in turn;
+       count the games of this shard first so that progress is announced against the right total */
+    rr.total_games = 0;
+    for (size_t x = 0; x < K; ++x) {
+        for (size_t y = x; y < K; ++y) {
+            if ((int)(class_pair_index(x, y, K) % shards) != shard) continue;
+            size_t size_x = rr.classes[x].size(), size_y = rr.classes[y].size();
+            rr.total_games += (int)(x == y ? size_x * (size_x - 1) / 2 : size_x * size_y);
+        }
+    }
+
+    // equivalent strategies tie: each wins exactly half of the games against the other
+    for (size_t x = 0; x < K; ++x) {
+        if ((int)(class_pair_index(x, x, K) % shards) != shard) continue;
+
+        record_class_result(rr, (int)x, (int)x, 0.5, 0, 1);
+    }
+
+    /* each class against the later ones whose results are not cached, WIN_RATE_BATCH at a time;
+       cached results go straight to the first scoreboard */
+    TournamentStats stats = { (int)K, rr.total_games, 0, 0, 0, 0, 0 };
+    std::vector<std::pair<int, int> > pairs;
+
+    for (size_t x = 0; x < K; ++x) {
+        for (size_t y = x + 1; y < K; ++y) {
+            if ((int)(class_pair_index(x, y, K) % shards) != shard) continue;
+
+            double avr;
+            if (rr.journal && rr.journal->lookup(rr.classes[x][0], rr.classes[y][0], avr)) {
+                record_class_result(rr, (int)x, (int)y, avr, 0, 1);
+                ++stats.games_resumed;
+                continue;
+            }
+
+            if (rr.cache && rr.keys[x] && rr.keys[y] && rr.cache->lookup(rr.keys[x], rr.keys[y], avr)) {
+                record_class_result(rr, (int)x, (int)y, avr, 0, 1);
+                ++stats.games_cached;
+                continue;
+            }
+
+            pairs.emplace_back((int)x, (int)y);
+        }
+    }
+
+    make_units(rr, pairs);
+    stats.games_evaluated = (int)pairs.size();
+    if (rr.telemetry) rr.telemetry->begin_phase("exact", (long long)pairs.size());
+
+    resize_win_rate_storage(threads);
+    if (!rr.interrupt || !*rr.interrupt) run_units(rr, threads);
+    resize_win_rate_storage(1);
+    stats.games_reused = rr.games_reused;
+    stats.states_saved = rr.states_saved;
+
+    // keep whatever was computed, even if interrupted
+    if (rr.journal) rr.journal->sync();
+    if (rr.cache) rr.cache->save();
+
+    // merge the scoreboards
+    victories.reserve(N);
+    for (size_t i = 0; i < N; ++i) {
+        int total = 0;
+        for (int t = 0; t < threads; ++t) total += rr.wins[t * N + i];
+        victories.emplace_back(total, strats[i].first);
+    }
+
+    std::sort(victories.begin(), victories.end(), wins_comparer);
+
+    return stats;
+}
+
+void count_victories(const std::vector<std::string> & names, const WinRateMatrix & win_rates,
+    std::vector<std::pair<int, std::string>> & victories, double margin) {
+
+    size_t N = names.size();
+    std::vector<int> wins(N, 0);
+
+    for (size_t i = 0; i < N; ++i) {
+        for (size_t j = i + 1; j < N; ++j) {
+            int winner = game_winner(win_rates.get(i, j), margin);
+            if (winner != -1) ++wins[winner ? j : i];
+        }
+    }
+
+    victories.clear();
+    for (size_t i = 0; i < N; ++i) victories.emplace_back(wins[i], names[i]);
+
+    std::sort(victories.begin(), victories.end(), wins_comparer);
+}
+
+// *** Swiss-system tournaments ***
+
+// hide from linkage
+namespace {
+    // sorts by points, then rating, in descending order, then by name
+    bool standing_comparer(const SwissStanding & a, const SwissStanding & b) {
+        if (a.points != b.points) return a.points > b.points;
+        if (a.rating != b.rating) return a.rating > b.rating;
+        return a.name < b.name;
+    }
+
+    /* Pairs the contestants for a round: in order of rating, each one not yet paired plays the next one
+       it has not played yet (or simply the next one if it has played them all). With an odd number,
+       the lowest-rated contestant with the fewest byes sits out first. Returns the one sitting out, or -1. */
+    int swiss_pairings(const std::vector<SwissStanding> & table, const std::vector<std::set<int> > & played,
+        std::vector<int> & byes, std::vector<std::pair<int, int> > & games) {
+
+        size_t N = table.size();
+
+        std::vector<int> order(N);
+        for (size_t i = 0; i < N; ++i) order[i] = (int)i;
+        std::stable_sort(order.begin(), order.end(), [&table](int a, int b) { return table[a].rating > table[b].rating; });
+
+        std::vector<char> paired(N, 0);
+        int bye = -1;
+
+        if (N % 2) {
+            bye = order[N - 1];
+            for (size_t p = N; p-- > 0;) {
+                if (byes[order[p]] < byes[bye]) bye = order[p];
+            }
+            ++byes[bye];
+            paired[bye] = 1;
+        }
+
+        for (size_t p = 0; p < N; ++p) {
+            int i = order[p];
+            if (paired[i]) continue;
+
+            int opponent = -1;
+            for (size_t q = p + 1; q < N; ++q) {
+                int j = order[q];
+                if (paired[j]) continue;
+                if (opponent == -1) opponent = j;
+                if (!played[i].count(j)) {
+                    opponent = j;
+                    break;
+                }
+            }
+
+            if (opponent == -1) break;
+            paired[i] = paired[opponent] = 1;
+            games.emplace_back(std::min(i, opponent), std::max(i, opponent));
+        }
+
+        return bye;
+    }
+}
+
+TournamentStats swiss(std::vector<std::pair<std::string, IStrategy *> > & strats,
+    std::vector<SwissStanding> & standings, int rounds,
+    void announcer(int games_played, int games_remaining, int high, std::string high_strat),
+    double margin, int threads,
+    volatile int * interrupt, MatchupCache * cache,
+    TournamentTelemetry * telemetry) {
+
+    compute_perms();
+
+    size_t N = strats.size();
+    if (threads <= 0) threads = 1;
+
+    std::vector<std::vector<int> > classes;
+    std::vector<unsigned long long> keys;
+    group_strategies(strats, classes, keys);
+
+    std::vector<int> class_of(N);
+    for (size_t x = 0; x < classes.size(); ++x) {
+        for (int i : classes[x]) class_of[i] = (int)x;
+    }
+
+    std::vector<SwissStanding> table(N);
+    for (size_t i = 0; i < N; ++i) {
+        table[i].name = strats[i].first;
+        table[i].rating = SWISS_INITIAL_RATING;
+        table[i].points = 0.0;
+        table[i].games = 0;
+    }
+
+    std::vector<std::set<int> > played(N);
+    std::vector<int> byes(N, 0);
+
+    // results of the games between classes x < y so far, by x * K + y
+    std::map<unsigned long long, double> known;
+
+    TournamentStats stats = { (int)classes.size(), 0, 0, 0, 0, 0, 0 };
+    int games_per_round = (int)(N / 2);
+
+    resize_win_rate_storage(threads);
+
+    for (int round = 0; round < rounds && !(interrupt && *interrupt); ++round) {
+        std::vector<std::pair<int, int> > games;
+        int bye = swiss_pairings(table, played, byes, games);
+
+        std::vector<double> results(games.size(), NAN);
+        std::vector<size_t> to_play;
+        std::map<unsigned long long, size_t> first_game;
+
+        for (size_t g = 0; g < games.size(); ++g) {
+            int x = class_of[games[g].first], y = class_of[games[g].second];
+            unsigned long long pair_key = (unsigned long long)std::min(x, y) * classes.size() + std::max(x, y);
+            double avr;
+
+            if (x == y) {
+                results[g] = 0.5;
+            }
+            else if (known.count(pair_key)) {
+                results[g] = x < y ? known[pair_key] : 1.0 - known[pair_key];
+            }
+            else if (cache && keys[x] && keys[y] && cache->lookup(keys[x], keys[y], avr)) {
+                results[g] = avr;
+                known[pair_key] = x < y ? avr : 1.0 - avr;
+                ++stats.games_cached;
+            }
+            else if (!first_game.count(pair_key)) {
+                first_game[pair_key] = g;
+                to_play.push_back(g);
+            }
+        }
+
+        // evaluate the new games in parallel, each by the first member of both classes
+        if (telemetry) {
+            telemetry->begin_phase("round " + std::to_string(round + 1), (long long)to_play.size(),
+                (long long)(rounds - round - 1) * games_per_round);
+        }
+
+        std::atomic<size_t> next(0);
+        auto job = [&](int worker, int) {
+            size_t k;
+            while ((k = next++) < to_play.size()) {
+                if (interrupt && *interrupt) return;
+
+                size_t g = to_play[k];
+                int x = class_of[games[g].first], y = class_of[games[g].second];
+                long long states = states_computed(worker);
+                results[g] = average_win_rate(*strats[classes[x][0]].second, *strats[classes[y][0]].second,
+                    -1, 0, 0, 0, worker);
+
+                if (telemetry) telemetry->record(worker, 1, states_computed(worker) - states);
+            }
+        };
+
+        if (threads == 1) job(0, 1);
+        else worker_pool(threads).run(job);
+
+        // the round is abandoned if interrupted
+        if (interrupt && *interrupt) break;
+
+        for (size_t g : to_play) {
+            int x = class_of[games[g].first], y = class_of[games[g].second];
+            known[(unsigned long long)std::min(x, y) * classes.size() + std::max(x, y)] = x < y ? results[g] : 1.0 - results[g];
+            if (cache && keys[x] && keys[y]) cache->insert(keys[x], keys[y], results[g]);
+            ++stats.games_evaluated;
+        }
+
+        for (size_t g = 0; g < games.size(); ++g) {
+            if (std::isnan(results[g])) {
+                // the same pair of classes was played earlier in this round
+                int x = class_of[games[g].first], y = class_of[games[g].second];
+                double avr = known[(unsigned long long)std::min(x, y) * classes.size() + std::max(x, y)];
+                results[g] = x < y ? avr : 1.0 - avr;
+            }
+        }
+
+        // update the ratings from the ratings at the start of the round, so the order of the games does not matter
+        std::vector<double> delta(N, 0.0);
+
+        for (size_t g = 0; g < games.size(); ++g) {
+            int i = games[g].first, j = games[g].second;
+            double avr = results[g];
+
+            // the score of i: 1 for a win, 1/2 for a tie and 0 for a loss, as the round robin counts them
+            int winner = game_winner(avr, margin);
+            double score = winner == -1 ? 0.5 : winner ? 0.0 : 1.0;
+
+            table[i].points += score;
+            table[j].points += 1.0 - score;
+
+            double expected = 1.0 / (1.0 + pow(10.0, (table[j].rating - table[i].rating) / 400.0));
+            delta[i] += SWISS_K_FACTOR * (score - expected);
+            delta[j] -= SWISS_K_FACTOR * (score - expected);
+
+            ++table[i].games;
+            ++table[j].games;
+            played[i].insert(j);
+            played[j].insert(i);
+        }
+
+        for (size_t i = 0; i < N; ++i) table[i].rating += delta[i];
+        stats.games += (int)games.size();
+
+        // sitting out scores as a win, without a game to move the rating
+        if (bye != -1) table[bye].points += 1.0;
+
+        if (announcer && N) {
+            int leader = 0;
+            for (size_t i = 1; i < N; ++i) {
+                if (standing_comparer(table[i], table[leader])) leader = (int)i;
+            }
+            announcer(stats.games, (rounds - round - 1) * games_per_round, (int)table[leader].points, table[leader].name);
+        }
+    }
+
+    resize_win_rate_storage(1);
+    if (cache) cache->save();
+
+    standings = table;
+    std::sort(standings.begin(), standings.end(), standing_comparer);
+
+    return stats;
+}
+
+int top_k_agreement(const std::vector<std::string> & ranking,
+    const std::vector<std::pair<int, std::string>> & victories, int k) {
+
+    // the wins needed to place in the top k of the round robin
+    if (k <= 0 || victories.empty()) return 0;
+    int cutoff = victories[std::min((size_t)k, victories.size()) - 1].first;
+
+    std::set<std::string> top;
+    for (auto & v : victories) {
+        if (v.first >= cutoff) top.insert(v.second);
+    }
+
+    int agree = 0;
+    for (size_t i = 0; i < ranking.size() && i < (size_t)k; ++i) agree += (int)top.count(ranking[i]);
+    return agree;
+}
+
+// *** Sharded tournaments ***
+
+bool write_shard_results(const std::string & path, int shard, int shards,
+    std::vector<std::pair<std::string, IStrategy *> > & strats, const WinRateMatrix & win_rates) {
+
+    std::ofstream ofs(path);
+    if (!ofs) return false;
+
+    size_t N = strats.size();
+
+    ofs << SHARD_FILE_HEADER << " " << SHARD_FILE_VERSION << "\n";
+    ofs << "shard " << shard + 1 << " " << shards << "\n";
+    ofs << "strategies " << N << "\n";
+
+    for (size_t i = 0; i < N; ++i) {
+        MatrixStrategy * mat = dynamic_cast<MatrixStrategy *>(strats[i].second);
+        ofs << std::hex << (mat ? MatchupCache::fingerprint(*mat) : 0ULL) << std::dec << " " << strats[i].first << "\n";
+    }
+
+    size_t games = 0;
+    for (size_t i = 0; i < N; ++i) {
+        for (size_t j = i + 1; j < N; ++j) games += win_rates.has(i, j);
+    }
+
+    // enough digits to read back the exact same doubles
+    ofs << "games " << games << "\n" << std::setprecision(17);
+
+    for (size_t i = 0; i < N; ++i) {
+        for (size_t j = i + 1; j < N; ++j) {
+            if (win_rates.has(i, j)) ofs << i << " " << j << " " << win_rates.get(i, j) << "\n";
+        }
+    }
+
+    ofs.flush();
+    return !ofs.fail();
+}
+
+bool read_shard_results(const std::vector<std::string> & paths, std::vector<std::string> & names,
+    WinRateMatrix & win_rates, std::string & error) {
+
+    std::vector<std::string> fingerprints;
+    std::vector<char> shard_seen;
+    size_t N = 0;
+    int shards = 0;
+
+    for (const std::string & path : paths) {
+        std::ifstream ifs(path);
+        if (!ifs) {
+            error = "could not open '" + path + "'";
+            return false;
+        }
+
+        std::string header, word;
+        int version = 0, shard = 0, file_shards = 0;
+        size_t file_N = 0;
+
+        ifs >> header >> version >> word >> shard >> file_shards;
+        if (header != SHARD_FILE_HEADER || version != SHARD_FILE_VERSION || word != "shard") {
+            error = "'" + path + "' is not a tournament shard file";
+            return false;
+        }
+
+        ifs >> word >> file_N;
+        if (ifs.fail() || word != "strategies" || file_shards <= 0 || shard < 1 || shard > file_shards) {
+            error = "'" + path + "' is corrupt";
+            return false;
+        }
+
+        // the first shard sets the strategies and the number of shards; the others must agree
+        if (shards == 0) {
+            shards = file_shards;
+            N = file_N;
+            shard_seen.assign(shards, 0);
+            win_rates.reset(N);
+        }
+        else if (file_shards != shards || file_N != N) {
+            error = "'" + path + "' is from a different tournament";
+            return false;
+        }
+
+        if (shard_seen[shard - 1]) {
+            error = "shard " + std::to_string(shard) + " was given more than once";
+            return false;
+        }
+        shard_seen[shard - 1] = 1;
+
+        for (size_t i = 0; i < N; ++i) {
+            std::string fingerprint, name;
+            ifs >> fingerprint;
+            while (ifs.peek() == ' ') ifs.get();
+            std::getline(ifs, name);
+
+            if (fingerprints.size() < N) {
+                fingerprints.push_back(fingerprint);
+                names.push_back(name);
+            }
+            else if (fingerprints[i] != fingerprint || names[i] != name) {
+                error = "'" + path + "' is from a different tournament (strategy '" + name + "' differs)";
+                return false;
+            }
+        }
+
+        size_t games = 0;
+        ifs >> word >> games;
+        if (ifs.fail() || word != "games") {
+            error = "'" + path + "' is corrupt";
+            return false;
+        }
+
+        for (size_t g = 0; g < games; ++g) {
+            size_t i, j;
+            double avr;
+            ifs >> i >> j >> avr;
+
+            if (ifs.fail() || i >= j || j >= N) {
+                error = "'" + path + "' is corrupt or incomplete";
+                return false;
+            }
+            if (win_rates.has(i, j)) {
+                error = "the game between '" + names[i] + "' and '" + names[j] + "' is in more than one shard";
+                return false;
+            }
+
+            win_rates.set(i, j, avr);
+        }
+    }
+
+    if (shards == 0) {
+        error = "no shard files given";
+        return false;
+    }
+
+    for (int s = 0; s < shards; ++s) {
+        if (!shard_seen[s]) {
+            error = "shard " + std::to_string(s + 1) + " of " + std::to_string(shards) + " is missing";
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < N; ++i) {
+        for (size_t j = i + 1; j < N; ++j) {
+            if (!win_rates.has(i, j)) {
+                error = "the game between '" + names[i] + "' and '" + names[j] + "' is missing";
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// *** Implementation of TournamentJournal class ***
+
+TournamentJournal::TournamentJournal(const std::string & path, unsigned long long id, bool resume)
+    : path(path), file(NULL), pending_lines(0) {
+
+    std::stringstream header;
+    header << JOURNAL_HEADER << " " << JOURNAL_VERSION << " " << std::hex << id;
+
+    // the header, then the lines of the earlier run up to the first torn or unreadable line
+    std::string contents = header.str() + "\n";
+
+    if (resume) {
+        std::ifstream ifs(path);
+        std::string line;
+
+        if (std::getline(ifs, line) && line == header.str()) {
+            while (std::getline(ifs, line) && !ifs.eof()) {
+                std::istringstream iss(line);
+                int i, j;
+                double avr;
+                std::string rest;
+
+                if (!(iss >> i >> j >> avr) || (iss >> rest) || i < 0 || j < 0) break;
+
+                results[journal_key(i, j)] = avr;
+                contents += line + "\n";
+            }
+        }
+    }
+
+    // write out the journal anew, then keep appending to it
+    std::string tmp_path = path + ".tmp";
+    FILE * tmp = fopen(tmp_path.c_str(), "wb");
+    if (!tmp) return;
+
+    bool written = fwrite(contents.data(), 1, contents.size(), tmp) == contents.size() && sync_file(tmp);
+    fclose(tmp);
+
+#ifdef _WIN32
+    // rename does not replace existing files on Windows
+    std::remove(path.c_str());
+#endif
+
+    if (written && std::rename(tmp_path.c_str(), path.c_str()) == 0) {
+        file = fopen(path.c_str(), "ab");
+    }
+}
+
+TournamentJournal::~TournamentJournal() {
+    if (file) {
+        sync();
+        fclose(file);
+    }
+}
+
+unsigned long long TournamentJournal::tournament_id(std::vector<std::pair<std::string, IStrategy *>> & strats,
+    int shard, int shards) {
+
+    std::stringstream desc;
+    desc << GOAL << " " << DICE_SIDES << " " << MAX_ROLLS << " " << MOD_TROT << " " <<
+        enable_swine_swap << " " << enable_time_trot << " " << shard << " " << shards << "\n";
+
+    for (auto & s : strats) {
+        MatrixStrategy * mat = dynamic_cast<MatrixStrategy *>(s.second);
+        desc << (mat ? MatchupCache::fingerprint(*mat) : 0ULL) << " " << s.first << "\n";
+    }
+
+    // 64-bit FNV-1a
+    unsigned long long id = 14695981039346656037ULL;
+    for (char c : desc.str()) {
+        id ^= (unsigned char)c;
+        id *= 1099511628211ULL;
+    }
+    return id;
+}
+
+bool TournamentJournal::lookup(int i, int j, double & win_rate) const {
+    auto it = results.find(journal_key(i, j));
+    if (it == results.end()) return false;
+
+    win_rate = it->second;
+    return true;
+}
+
+void TournamentJournal::append(int i, int j, double win_rate) {
+    // enough digits to read back the exact same double
+    char line[64];
+    snprintf(line, sizeof line, "%d %d %.17g\n", i, j, win_rate);
+
+    std::string batch;
+    {
+        std::lock_guard<std::mutex> lck(pending_mtx);
+        auto now = std::chrono::steady_clock::now();
+
+        if (pending_lines == 0) pending_since = now;
+        pending += line;
+        ++pending_lines;
+
+        if (pending_lines >= SYNC_LINES || now - pending_since >= std::chrono::seconds(SYNC_SECONDS)) {
+            batch.swap(pending);
+            pending_lines = 0;
+        }
+    }
+
+    if (!batch.empty()) {
+        std::lock_guard<std::mutex> lck(write_mtx);
+        write_lines(batch);
+    }
+}
+
+void TournamentJournal::sync() {
+    std::string batch;
+    {
+        std::lock_guard<std::mutex> lck(pending_mtx);
+        batch.swap(pending);
+        pending_lines = 0;
+    }
+
+    std::lock_guard<std::mutex> lck(write_mtx);
+    write_lines(batch);
+}
+
+void TournamentJournal::write_lines(const std::string & lines) {
+    if (!file || lines.empty()) return;
+
+    fwrite(lines.data(), 1, lines.size(), file);
+    sync_file(file);
+}
+
+void TournamentJournal::remove() {
+    std::lock_guard<std::mutex> lck(write_mtx);
+    if (!file) return;
+
+    fclose(file);
+    file = NULL;
+    std::remove(path.c_str());
+}
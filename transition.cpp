@@ -0,0 +1,190 @@
+#include "stdafx.h"
+#include "transition.h"
+#include "hog.h"
+
+// *** Dice permutations ***
+
+int total_roll_perms[MAX_ROLLS + 1];
+int total_roll_perms_for_sum[MAX_ROLLS + 1][DICE_SIDES * MAX_ROLLS + 1];
+double prob_roll_sum[MAX_ROLLS + 1][DICE_SIDES * MAX_ROLLS + 1];
+double prob_any_roll_sum[DICE_SIDES * MAX_ROLLS + 1];
+
+// hide from linkage
+namespace {
+    std::once_flag perms_flag;
+
+    // computes the dice permutation tables (see compute_perms)
+    void compute_perms_once() {
+        memset(total_roll_perms_for_sum, 0, sizeof total_roll_perms_for_sum);
+        memset(prob_any_roll_sum, 0, sizeof prob_any_roll_sum);
+        memset(prob_roll_sum, 0, sizeof prob_roll_sum);
+
+        total_roll_perms[0] = 1;
+        total_roll_perms_for_sum[0][0] = 1; // base case
+
+        for (int i = 1; i <= MAX_ROLLS; ++i) {
+
+            total_roll_perms[i] = total_roll_perms[i - 1] * DICE_SIDES;
+
+            // the lowest possible sum for the previous number of rolls
+            int prev_low = 2 * (i - 1);
+
+            // used to add up all the permutations so we can see if the sum matches the expected total.
+            int check_sum = 0;
+
+            // add # ways of getting a score of one due to Pig Out
+            int num_ones = 0, last_pow = 1, last_choose = 1;
+
+            for (int j = 1; j <= i; ++j) {
+                num_ones += last_choose * last_pow;
+                last_pow *= 5;
+                last_choose = last_choose * (i - j + 1) / j;
+            }
+
+            total_roll_perms_for_sum[i][1] += num_ones;
+            prob_roll_sum[i][1] += (double)num_ones / total_roll_perms[i];
+
+            prob_any_roll_sum[1] += prob_roll_sum[i][1] / 8.0;
+
+            check_sum += num_ones;
+
+            // sum up permutations for getting all other scores
+
+            // rolling sum to reduce complexity by m (DICE_SIDES)
+            int rolling = 0;
+
+            for (int j = DICE_SIDES * i - DICE_SIDES + 1; j < DICE_SIDES * i; ++j) {
+                rolling += total_roll_perms_for_sum[i - 1][j];
+            }
+
+            for (int j = DICE_SIDES * i; j >= 2 * i; --j) {
+
+                // update rolling sum
+                if (j - 1 >= prev_low) rolling -= total_roll_perms_for_sum[i - 1][j - 1];
+                if (j - DICE_SIDES >= prev_low) rolling += total_roll_perms_for_sum[i - 1][j - DICE_SIDES];
+
+                total_roll_perms_for_sum[i][j] = rolling;
+                check_sum += rolling;
+
+                prob_roll_sum[i][j] = (double)rolling / total_roll_perms[i];
+                prob_any_roll_sum[j] += prob_roll_sum[i][j] / 10.0;
+            }
+
+            // totals don't match, maybe we have a bug!
+            if (check_sum != total_roll_perms[i])
+                throw "Permutations mismatch in compute_sums";
+        }
+    }
+
+    // rounds 'size' up to a whole number of cache lines
+    inline size_t cache_align(size_t size) {
+        return (size + 63) / 64 * 64;
+    }
+
+    // the sum rolled by the j-th outcome of rolling r > 0 dice: 1 (Pig Out), then 2r ... 6r
+    inline int outcome_sum(int r, int j) {
+        return j == 0 ? 1 : 2 * r - 1 + j;
+    }
+
+    // number of outcomes of rolling r dice
+    inline int outcome_count(int r) {
+        return r == 0 ? 1 : (DICE_SIDES - 2) * r + 2;
+    }
+}
+
+void compute_perms() {
+    std::call_once(perms_flag, compute_perms_once);
+}
+
+// *** Implementation of TransitionTable ***
+
+TransitionTable::TransitionTable(bool swap) {
+    compute_perms();
+
+    // count the non-terminal outcomes (score + k < GOAL) of every move so everything fits in one allocation
+    size_t total_next = 0;
+    for (int score = 0; score < GOAL; ++score) {
+        for (int oppo_score = 0; oppo_score < GOAL; ++oppo_score) {
+            if (score + free_bacon(oppo_score) < GOAL) ++total_next;
+
+            for (int r = 1; r <= MAX_ROLLS; ++r) {
+                for (int j = 0; j < outcome_count(r) && score + outcome_sum(r, j) < GOAL; ++j) ++total_next;
+            }
+        }
+    }
+
+    size_t move_bytes = cache_align(sizeof(Moves) * PAIRS * (MAX_ROLLS + 1));
+    size_t weight_bytes = cache_align(sizeof(double) * (MAX_ROLLS + 1) * MAX_OUTCOMES);
+    size_t flip_bytes = cache_align(sizeof(unsigned short) * PAIRS);
+    size_t next_bytes = cache_align(sizeof(unsigned short) * total_next);
+
+    storage = new char[move_bytes + weight_bytes + flip_bytes + next_bytes + 64];
+    char * base = storage + (64 - (size_t)storage % 64) % 64;
+
+    move_info = (Moves *)base;
+    weight = (double *)(base + move_bytes);
+    flipped = (unsigned short *)(base + move_bytes + weight_bytes);
+    next_pair = (unsigned short *)(base + move_bytes + weight_bytes + flip_bytes);
+
+    // weights of outcomes only depend on the number of dice
+    std::fill(weight, weight + (MAX_ROLLS + 1) * MAX_OUTCOMES, 0.0);
+    weight[0] = 1.0;
+    inv_total_weight[0] = 1.0;
+
+    for (int r = 1; r <= MAX_ROLLS; ++r) {
+        for (int j = 0; j < outcome_count(r); ++j) {
+            weight[r * MAX_OUTCOMES + j] = total_roll_perms_for_sum[r][outcome_sum(r, j)];
+        }
+        inv_total_weight[r] = 1.0 / total_roll_perms[r];
+    }
+
+    size_t pos = 0;
+
+    for (int score = 0; score < GOAL; ++score) {
+        for (int oppo_score = 0; oppo_score < GOAL; ++oppo_score) {
+            int pair = index(score, oppo_score);
+            flipped[pair] = (unsigned short)index(oppo_score, score);
+
+            for (int r = 0; r <= MAX_ROLLS; ++r) {
+                Moves & m = move_info[pair * (MAX_ROLLS + 1) + r];
+                m.offset = (int)pos;
+                m.count = 0;
+                m.win_weight = m.cont_weight = 0.0;
+
+                for (int j = 0; j < outcome_count(r); ++j) {
+                    // for zero rolls, the change in score is given by the free bacon rule
+                    int k = r == 0 ? free_bacon(oppo_score) : outcome_sum(r, j);
+                    double w = weights(r)[j];
+
+                    int new_score = score + k, new_oppo_score = oppo_score;
+                    bool swapped = swap && swap_condition(new_score, new_oppo_score);
+                    if (swapped) std::swap(new_score, new_oppo_score);
+
+                    if (score + k >= GOAL) {
+                        // immediate win, unless the swap hands the opponent the winning score
+                        if (!swapped) m.win_weight += w;
+                    }
+                    else {
+                        next_pair[pos++] = (unsigned short)index(new_oppo_score, new_score);
+                        m.cont_weight += w;
+                        ++m.count;
+                    }
+                }
+            }
+        }
+    }
+}
+
+TransitionTable::~TransitionTable() {
+    delete[] storage;
+}
+
+const TransitionTable & transitions() {
+    static std::once_flag flags[2];
+    static TransitionTable * tables[2];
+
+    int swap = enable_swine_swap ? 1 : 0;
+    std::call_once(flags[swap], [swap]() { tables[swap] = new TransitionTable(swap != 0); });
+
+    return *tables[swap];
+}
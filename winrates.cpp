@@ -0,0 +1,166 @@
+#include "stdafx.h"
+#include "winrates.h"
+#include "mapping.h"
+
+// hide from linkage
+namespace {
+    // identifies a win rate file (and its byte order)
+    const unsigned long long WIN_RATE_FILE_MAGIC = 0x314d52574e434142ULL; // "BACNWRM1"
+
+    // version of the win rate file format
+    const unsigned WIN_RATE_FILE_VERSION = 1;
+
+    // the entries start at a multiple of this many bytes
+    const size_t WIN_RATE_FILE_ALIGN = 64;
+
+    struct WinRateHeader {
+        unsigned long long magic;
+        unsigned version, entry_size;
+        unsigned long long strategies, names_offset, entries_offset;
+        unsigned long long reserved[3];
+    };
+
+    // Number of entries in a packed upper triangle for N strategies
+    inline size_t triangle_size(size_t N) {
+        return N * (N - (N > 0)) / 2;
+    }
+
+}
+
+// *** Implementation of WinRateMatrix class ***
+
+WinRateMatrix::WinRateMatrix(size_t N) : N(0), entries(NULL), file_floats(NULL), mapping(NULL) {
+    reset(N);
+}
+
+WinRateMatrix::WinRateMatrix(const std::string & path, const std::vector<std::string> & names, bool single)
+    : N(names.size()), entries(NULL), file_floats(NULL), mapping(NULL) {
+
+    static_assert(sizeof(WinRateHeader) == 64, "win rate file header must be 64 bytes");
+
+    WinRateHeader header = {};
+    header.magic = WIN_RATE_FILE_MAGIC;
+    header.version = WIN_RATE_FILE_VERSION;
+    header.entry_size = single ? sizeof(float) : sizeof(double);
+    header.strategies = N;
+    header.names_offset = sizeof header;
+
+    size_t names_size = 0;
+    for (const std::string & name : names) names_size += name.size() + 1;
+
+    header.entries_offset = (sizeof header + names_size + WIN_RATE_FILE_ALIGN - 1) / WIN_RATE_FILE_ALIGN * WIN_RATE_FILE_ALIGN;
+    size_t count = triangle_size(N);
+
+    mapping = map_file(path, MAP_CREATE, (size_t)header.entries_offset + count * header.entry_size);
+    if (!mapping) return;
+
+    memcpy(mapping->data, &header, sizeof header);
+
+    char * name_ptr = mapping->data + header.names_offset;
+    for (const std::string & name : names) {
+        memcpy(name_ptr, name.c_str(), name.size() + 1);
+        name_ptr += name.size() + 1;
+    }
+
+    char * file_entries = mapping->data + header.entries_offset;
+
+    if (single) {
+        file_floats = (float *)file_entries;
+        std::fill(file_floats, file_floats + count, NAN);
+
+        memory.assign(std::max(count, (size_t)1), NAN);
+        entries = memory.data();
+    }
+    else {
+        entries = (double *)file_entries;
+        std::fill(entries, entries + count, NAN);
+    }
+}
+
+WinRateMatrix::~WinRateMatrix() {
+    release();
+}
+
+void WinRateMatrix::release() {
+    if (mapping) {
+        sync_mapping(mapping);
+        unmap_file(mapping);
+        mapping = NULL;
+    }
+    entries = NULL;
+    file_floats = NULL;
+    memory.clear();
+}
+
+void WinRateMatrix::reset(size_t N) {
+    release();
+
+    this->N = N;
+
+    memory.assign(std::max(triangle_size(N), (size_t)1), NAN);
+    entries = memory.data();
+}
+
+bool WinRateMatrix::flush() {
+    return !mapping || sync_mapping(mapping);
+}
+
+// *** Implementation of WinRateFile class ***
+
+WinRateFile::WinRateFile(const std::string & path) : single(false), entries(NULL), mapping(NULL) {
+    FileMapping * m = map_file(path, MAP_READ);
+    if (!m) return;
+
+    WinRateHeader header;
+    bool valid = m->size >= sizeof header;
+
+    if (valid) {
+        memcpy(&header, m->data, sizeof header);
+        valid = header.magic == WIN_RATE_FILE_MAGIC && header.version == WIN_RATE_FILE_VERSION &&
+            (header.entry_size == sizeof(float) || header.entry_size == sizeof(double)) &&
+            header.names_offset == sizeof header && header.entries_offset <= m->size &&
+            header.entries_offset % WIN_RATE_FILE_ALIGN == 0 &&
+            (m->size - header.entries_offset) / header.entry_size >= triangle_size((size_t)header.strategies);
+    }
+
+    // the names: consecutive null-terminated strings before the entries
+    const char * p = m->data + sizeof header, * end = m->data + (valid ? header.entries_offset : 0);
+    for (unsigned long long i = 0; valid && i < header.strategies; ++i) {
+        const char * name_end = std::find(p, end, '\0');
+        if (name_end == end) valid = false;
+        else {
+            names.emplace_back(p, name_end);
+            p = name_end + 1;
+        }
+    }
+
+    if (!valid) {
+        names.clear();
+        unmap_file(m);
+        return;
+    }
+
+    single = header.entry_size == sizeof(float);
+    entries = m->data + header.entries_offset;
+    mapping = m;
+}
+
+WinRateFile::~WinRateFile() {
+    unmap_file(mapping);
+}
+
+double WinRateFile::get(size_t i, size_t j) const {
+    if (i == j) return 0.5;
+
+    size_t N = names.size();
+    size_t lo = std::min(i, j), hi = std::max(i, j);
+    size_t k = lo * (2 * N - lo - 1) / 2 + (hi - lo - 1);
+
+    double win_rate = single ? ((const float *)entries)[k] : ((const double *)entries)[k];
+    return i < j ? win_rate : 1.0 - win_rate;
+}
+
+void WinRateFile::row(size_t i, std::vector<double> & win_rates) const {
+    win_rates.resize(names.size());
+    for (size_t j = 0; j < names.size(); ++j) win_rates[j] = get(i, j);
+}